@@ -0,0 +1,74 @@
+#include "aligned_resource.h"
+#include <algorithm>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace spleeter {
+
+/// Size of a transparent huge page on x86-64 and most arm64 kernels.
+static constexpr std::size_t kHugePageSize = 2 << 20;
+
+AlignedResource::AlignedResource(std::size_t huge_page_threshold)
+    : huge_page_threshold_(huge_page_threshold) {}
+
+bool AlignedResource::use_huge_pages(std::size_t size) const {
+#ifdef __linux__
+  return huge_page_threshold_ && size >= huge_page_threshold_;
+#else
+  (void)size;
+  return false;
+#endif
+}
+
+void *AlignedResource::do_allocate(std::size_t bytes, std::size_t alignment) {
+  const std::size_t size = padded_size(bytes);
+  alignment = std::max(alignment, kAlignment);
+
+#ifdef __linux__
+  /* The decision only depends on the size, do_deallocate gets the same one
+   * back and takes the same branch. */
+  if (use_huge_pages(size) && alignment <= kHugePageSize) {
+    const std::size_t length =
+        (size + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+    void *p = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    /* Advisory only, the mapping works with normal pages too. */
+    madvise(p, length, MADV_HUGEPAGE);
+    return p;
+  }
+#endif
+  return ::operator new(size, std::align_val_t(alignment));
+}
+
+void AlignedResource::do_deallocate(void *p, std::size_t bytes,
+                                    std::size_t alignment) {
+  const std::size_t size = padded_size(bytes);
+  alignment = std::max(alignment, kAlignment);
+
+#ifdef __linux__
+  if (use_huge_pages(size) && alignment <= kHugePageSize) {
+    munmap(p, (size + kHugePageSize - 1) / kHugePageSize * kHugePageSize);
+    return;
+  }
+#endif
+  ::operator delete(p, size, std::align_val_t(alignment));
+}
+
+bool AlignedResource::do_is_equal(
+    const std::pmr::memory_resource &other) const noexcept {
+  return this == &other;
+}
+
+AlignedResource *sample_memory() {
+  /* Never destroyed, containers in static storage may outlive main. */
+  static AlignedResource *resource = new AlignedResource(4 << 20);
+  return resource;
+}
+
+} // namespace spleeter
@@ -0,0 +1,51 @@
+#ifndef SPLEETER_ALIGNED_RESOURCE_H
+#define SPLEETER_ALIGNED_RESOURCE_H
+
+#include <cstddef>
+#include <memory_resource>
+
+namespace spleeter {
+
+/// memory_resource for sample buffers. Every block starts on a 64-byte
+/// boundary and its size is rounded up to a multiple of 64 bytes, so vector
+/// loops may read or write the last partial vector of a buffer without a
+/// scalar tail. Blocks of at least huge_page_threshold bytes are mapped
+/// separately and marked for transparent huge pages where the OS supports
+/// it. The blocks are ordinary memory: data() can go to swr_convert or
+/// av_audio_fifo_write as before.
+class AlignedResource : public std::pmr::memory_resource {
+  std::size_t huge_page_threshold_;
+
+  bool use_huge_pages(std::size_t size) const;
+
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+
+  void do_deallocate(void *p, std::size_t bytes,
+                     std::size_t alignment) override;
+
+  bool do_is_equal(
+      const std::pmr::memory_resource &other) const noexcept override;
+
+public:
+  static constexpr std::size_t kAlignment = 64;
+
+  /// huge_page_threshold 0 never maps huge pages.
+  explicit AlignedResource(std::size_t huge_page_threshold = 0);
+
+  AlignedResource(const AlignedResource &) = delete;
+
+  AlignedResource &operator=(const AlignedResource &) = delete;
+
+  /// Bytes actually reserved for a request of bytes.
+  static std::size_t padded_size(std::size_t bytes) {
+    return (bytes + kAlignment - 1) / kAlignment * kAlignment;
+  }
+};
+
+/// Process wide resource Waveform storage comes from unless another one is
+/// given: aligned and padded, huge pages from 4 MiB on.
+AlignedResource *sample_memory();
+
+} // namespace spleeter
+
+#endif
@@ -0,0 +1,126 @@
+#include "favutil/sample_kernels.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+using namespace avpro::kernels;
+
+/// Times every kernel of every instruction set the CPU has against the scalar
+/// reference, and checks that the results agree.
+/// usage: bench_sample_kernels [nb_frames] [iterations]
+
+static double seconds_per_call(const std::function<void()> &call,
+                               int iterations) {
+  call();
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    call();
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / iterations;
+}
+
+static float max_difference(const std::vector<float> &a,
+                            const std::vector<float> &b) {
+  float result = 0;
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    result = std::max(result, std::fabs(a[i] - b[i]));
+  }
+  return result;
+}
+
+int main(int argc, char **argv) {
+  const std::size_t nb_frames = argc > 1 ? std::atol(argv[1]) : 44100 * 10;
+  const int iterations = argc > 2 ? std::atoi(argv[2]) : 50;
+  const std::size_t n = nb_frames * 2;
+
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> dist(-1.2f, 1.2f);
+  std::vector<float> a(n), b(n), dst(n), left(nb_frames), right(nb_frames);
+  std::vector<int16_t> s16(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    a[i] = dist(rng);
+    b[i] = dist(rng);
+  }
+  const KernelTable &ref = *kernels_for(Isa::kScalar);
+  ref.float_to_s16(s16.data(), a.data(), n);
+
+  std::printf("%zu stereo frames, %d iterations, default %s\n", nb_frames,
+              iterations, isa_name(kernels().isa));
+  std::printf("%-14s %-7s %10s %8s %10s\n", "kernel", "isa", "Msamples/s",
+              "speedup", "max diff");
+
+  struct Case {
+    const char *name;
+    /// leaves its result in dst, compared with the scalar one
+    std::function<void(const KernelTable &)> run;
+  };
+  std::vector<int16_t> s16_out(n);
+  const std::vector<Case> cases{
+      {"gain", [&](const KernelTable &k) {
+         k.gain(dst.data(), a.data(), n, 0.5f);
+       }},
+      {"mix", [&](const KernelTable &k) {
+         std::copy(a.begin(), a.end(), dst.begin());
+         k.mix(dst.data(), b.data(), n, 0.5f);
+       }},
+      {"crossfade", [&](const KernelTable &k) {
+         k.crossfade(dst.data(), a.data(), b.data(), nb_frames, 2);
+       }},
+      {"interleave2", [&](const KernelTable &k) {
+         k.interleave2(dst.data(), a.data(), b.data(), nb_frames);
+       }},
+      {"deinterleave2", [&](const KernelTable &k) {
+         k.deinterleave2(left.data(), right.data(), a.data(), nb_frames);
+         std::copy(left.begin(), left.end(), dst.begin());
+         std::copy(right.begin(), right.end(), dst.begin() + nb_frames);
+       }},
+      {"float_to_s16", [&](const KernelTable &k) {
+         k.float_to_s16(s16_out.data(), a.data(), n);
+         std::copy(s16_out.begin(), s16_out.end(), dst.begin());
+       }},
+      {"s16_to_float", [&](const KernelTable &k) {
+         k.s16_to_float(dst.data(), s16.data(), n);
+       }},
+      {"peak", [&](const KernelTable &k) {
+         dst[0] = k.peak(a.data(), n);
+       }},
+      {"sum_squares", [&](const KernelTable &k) {
+         dst[0] = static_cast<float>(k.sum_squares(a.data(), n) / n);
+       }},
+      {"abs_sum", [&](const KernelTable &k) {
+         dst[0] = static_cast<float>(k.abs_sum(a.data(), n) / n);
+       }},
+      {"abs_sum_s16", [&](const KernelTable &k) {
+         dst[0] = static_cast<float>(k.abs_sum_s16(s16.data(), n));
+       }},
+  };
+
+  for (const Case &c : cases) {
+    std::fill(dst.begin(), dst.end(), 0.0f);
+    c.run(ref);
+    const std::vector<float> expected = dst;
+    const double ref_seconds =
+        seconds_per_call([&] { c.run(ref); }, iterations);
+
+    for (Isa isa : {Isa::kScalar, Isa::kSse2, Isa::kAvx2, Isa::kAvx512}) {
+      const KernelTable *k = kernels_for(isa);
+      if (!k) {
+        continue;
+      }
+      std::fill(dst.begin(), dst.end(), 0.0f);
+      c.run(*k);
+      const float diff = max_difference(expected, dst);
+      const double s = seconds_per_call([&] { c.run(*k); }, iterations);
+      std::printf("%-14s %-7s %10.1f %7.2fx %10.3g\n", c.name, isa_name(isa),
+                  n / s / 1e6, ref_seconds / s, diff);
+    }
+  }
+  return 0;
+}
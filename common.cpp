@@ -44,25 +44,112 @@ std::queue<spleeter::Waveform> segment_audio(const spleeter::Waveform &waveform,
   return result;
 }
 
-spleeter::Waveform restore_segment_audio(const Waveform &waveform,
-                                         std::size_t boundary_nb_samples,
-
-                                         bool head, bool tail) {
+spleeter::WaveformView restore_segment_audio(const WaveformView &waveform,
+                                             std::size_t boundary_nb_samples,
+                                             bool head, bool tail) {
   std::size_t start = 0;
   std::size_t end = waveform.nb_frames;
 
   if (head) {
     start += boundary_nb_samples;
   }
-  if (end) {
+  if (tail) {
     end -= boundary_nb_samples;
   }
   return waveform.sub_frames(start, end);
 }
 
-spleeter::Waveform restore_segment_audio(const Waveform &waveform,
-                                         std::size_t head_count,
-                                         std::size_t tail_count) {
+SegmentStream::SegmentStream(std::size_t segment_nb_samples,
+                             std::size_t boundary_nb_samples,
+                             std::int32_t nb_channels,
+                             std::pmr::memory_resource *memory)
+    : segment_nb_samples_(segment_nb_samples),
+      boundary_nb_samples_(boundary_nb_samples), memory_(memory),
+      window_(Waveform::with_resource(nb_channels, memory)) {
+  assert(segment_nb_samples > boundary_nb_samples);
+  reserve_window();
+}
+
+/// 窗口与segment_audio一致：第一个窗口为[0, segment + boundary)，
+/// 之后的窗口从上一个窗口结尾前2倍boundary开始
+std::size_t SegmentStream::window_end() const {
+  if (cursor_ == 0) {
+    return segment_nb_samples_ + boundary_nb_samples_;
+  }
+  return cursor_ + segment_nb_samples_;
+}
+
+/// 多预留一帧，用于判断窗口是否为最后一个，避免窗口缓冲区扩容拷贝
+void SegmentStream::reserve_window() {
+  window_.data.reserve((window_end() - start_ + 1) * window_.nb_channels);
+}
+
+std::size_t SegmentStream::nb_missing() const {
+  const std::size_t total = start_ + window_.nb_frames;
+  const std::size_t needed = window_end() + 1;
+  if (done_ || finished_ || total >= needed) {
+    return 0;
+  }
+  return needed - total;
+}
+
+Waveform &SegmentStream::input() { return window_; }
+
+void SegmentStream::append(const Waveform &waveform) {
+  assert(waveform.nb_channels == window_.nb_channels);
+  window_ += waveform;
+}
+
+void SegmentStream::finish() { finished_ = true; }
+
+std::optional<SegmentWindow> SegmentStream::next() {
+  if (done_) {
+    return std::nullopt;
+  }
+
+  const std::size_t total = start_ + window_.nb_frames;
+  std::size_t end = window_end();
+
+  /// 只有确定后面还有数据或者输入已结束，才知道窗口是否为最后一个
+  bool last;
+  if (total > end) {
+    last = false;
+  } else if (finished_) {
+    end = total;
+    last = true;
+  } else {
+    return std::nullopt;
+  }
+
+  /// 下一个窗口只拷贝重叠部分以及超出当前窗口的输入
+  const std::size_t nb_channels = window_.nb_channels;
+  Waveform following = Waveform::with_resource(nb_channels, memory_);
+  std::size_t following_start = 0;
+  if (!last) {
+    following_start = end - 2 * boundary_nb_samples_;
+    following.nb_frames = total - following_start;
+    following.data.reserve(
+        (2 * boundary_nb_samples_ + segment_nb_samples_ + 1) * nb_channels);
+    following.data.assign(
+        window_.data.cbegin() + (following_start - start_) * nb_channels,
+        window_.data.cbegin() + window_.nb_frames * nb_channels);
+    window_.nb_frames = end - start_;
+    window_.data.resize(window_.nb_frames * nb_channels);
+  }
+
+  /// 移动构造保留内存资源，窗口缓冲区直接交给调用者
+  std::optional<SegmentWindow> window(SegmentWindow{
+      .waveform = std::move(window_), .head = cursor_ != 0, .tail = !last});
+  window_ = std::move(following);
+  start_ = following_start;
+  cursor_ = end;
+  done_ = last;
+  return window;
+}
+
+spleeter::WaveformView restore_segment_audio(const WaveformView &waveform,
+                                             std::size_t head_count,
+                                             std::size_t tail_count) {
   std::size_t start = 0;
   std::size_t end = waveform.nb_frames;
 
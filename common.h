@@ -7,6 +7,7 @@
 #include <deque>
 #include <exception>
 #include <functional>
+#include <optional>
 #include <queue>
 #include <string>
 #include <vector>
@@ -49,9 +50,72 @@ std::queue<spleeter::Waveform> segment_audio(const Waveform &,
                                              std::size_t segment_nb_samples,
                                              std::size_t boundary_nb_samples);
 
-spleeter::Waveform restore_segment_audio(const Waveform &waveform,
-                                         std::size_t boundary_nb_samples,
-                                         bool head, bool tail);
+/// Trims the boundaries of a segment, the result views the same samples.
+spleeter::WaveformView restore_segment_audio(const WaveformView &waveform,
+                                             std::size_t boundary_nb_samples,
+                                             bool head, bool tail);
+
+/// One window of a SegmentStream.
+struct SegmentWindow {
+  /// the window's own samples, allocated from the stream's memory
+  Waveform waveform;
+  /// the flags to pass to restore_segment_audio for this window
+  bool head;
+  bool tail;
+};
+
+/// Streaming segment_audio: the input is appended piece by piece and the same
+/// windows come out. Every window is filled in its own buffer and handed out
+/// by move, the only samples copied are the overlap of 2 * boundary frames
+/// (and any input appended past the window) that start the next window.
+/// Memory does not grow with the input length.
+class SegmentStream {
+  std::size_t segment_nb_samples_;
+  std::size_t boundary_nb_samples_;
+  std::pmr::memory_resource *memory_;
+  /// the window being filled, its frame 0 is frame start_ of the stream
+  Waveform window_;
+  std::size_t start_{0};
+  /// end of the last emitted window, 0 before the first
+  std::size_t cursor_{0};
+  bool finished_{false};
+  bool done_{false};
+
+  /// End of the window being filled, in frames of the stream.
+  std::size_t window_end() const;
+
+  /// Reserve the window being filled up to its end and one frame more.
+  void reserve_window();
+
+public:
+  SegmentStream(std::size_t segment_nb_samples,
+                std::size_t boundary_nb_samples, std::int32_t nb_channels,
+                std::pmr::memory_resource *memory = sample_memory());
+
+  /// Frames still needed before next can emit the window being filled: up
+  /// to its end and one frame more, which shows it is not the last one.
+  std::size_t nb_missing() const;
+
+  /// Waveform to append the next input frames to, e.g. with
+  /// AudioDecoder::DecodeAppend. Appending at most nb_missing frames keeps
+  /// the copy to the next window at the overlap.
+  Waveform &input();
+
+  /// Copy frames to the end of the input.
+  void append(const Waveform &waveform);
+
+  /// No more input will follow.
+  void finish();
+
+  /// Next window if it is complete. The window takes the buffer over, the
+  /// following input goes to a new one.
+  std::optional<SegmentWindow> next();
+};
+
+/// Trim head_count frames from the front and tail_count from the back.
+spleeter::WaveformView restore_segment_audio(const WaveformView &waveform,
+                                             std::size_t head_count,
+                                             std::size_t tail_count);
 
 } // namespace spleeter
 
@@ -289,15 +289,9 @@ static void print_frame(const AVFrame *frame, FILE *outfile)
 {
     const int n = frame->nb_samples * frame->ch_layout.nb_channels;
     const uint16_t *p = (uint16_t *)frame->data[0];
-    const uint16_t *p_end = p + n;
 
-    while (p < p_end)
-    {
-        // fputc(*p & 0xff, stdout);
-        // fputc(*p >> 8 & 0xff, stdout);
-        fwrite(p, 2, 1, outfile);
-        p++;
-    }
+    /* packed s16, the whole frame goes out in one call */
+    fwrite(p, 2, n, outfile);
     // fflush(stdout);
 
     // int data_size = av_get_bytes_per_sample(dec_ctx->sample_fmt);
@@ -4,12 +4,29 @@ int avpro::CommonMedia::open_input(std::string_view url)
 {
     int ret;
 
-    if ((ret = avformat_open_input(&fmt_ctx, url.data(), NULL, NULL)) < 0)
+    if ((ret = avpro::open_input(&fmt_ctx, url.data())) < 0)
     {
         av_log(NULL, AV_LOG_ERROR, "Cannot open input file\n");
         return ret;
     }
-    if ((ret = avformat_find_stream_info(fmt_ctx, NULL)) < 0)
+    if ((ret = avpro::find_stream_info(fmt_ctx, fmt_ctx->url, fast_open)) < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Cannot find stream information\n");
+        return ret;
+    }
+    return 0;
+}
+
+int avpro::CommonMedia::open_input(const InputSource &source)
+{
+    int ret;
+
+    if ((ret = avpro::open_input(&fmt_ctx, NULL, &source)) < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Cannot open input source\n");
+        return ret;
+    }
+    if ((ret = avpro::find_stream_info(fmt_ctx, NULL, fast_open)) < 0)
     {
         av_log(NULL, AV_LOG_ERROR, "Cannot find stream information\n");
         return ret;
@@ -256,15 +273,21 @@ int avpro::CommonMedia::decode(std::unique_ptr<CommonMediaContext> &context, std
     AVFilterContext *buffersrc_ctx = filter_context->buffersrc_ctx;
 
     int ret;
-    AVPacket *packet = av_packet_alloc();
-    AVFrame *frame = av_frame_alloc();
+    AVPacket *packet = pool->acquire_packet();
+    AVFrame *frame = pool->acquire_frame();
 
     if (!packet || !frame)
     {
         fprintf(stderr, "Could not allocate frame or packet\n");
+        pool->release_packet(packet);
+        pool->release_frame(frame);
         return -1;
     }
 
+    /* only the audio stream is demuxed, other payloads are skipped where the
+     * demuxer can */
+    avpro::discard_other_streams(fmt_ctx, audio_stream_index);
+
     /* read all packets */
     int64_t total_samples = 0;
     while (1)
@@ -274,6 +297,7 @@ int avpro::CommonMedia::decode(std::unique_ptr<CommonMediaContext> &context, std
 
         if (packet->stream_index == audio_stream_index)
         {
+            bytes_used += packet->size;
             ret = avcodec_send_packet(dec_ctx, packet);
             if (ret < 0)
             {
@@ -310,8 +334,8 @@ int avpro::CommonMedia::decode(std::unique_ptr<CommonMediaContext> &context, std
         av_packet_unref(packet);
     }
 end:
-    av_packet_free(&packet);
-    av_frame_free(&frame);
+    pool->release_packet(packet);
+    pool->release_frame(frame);
 
     const int64_t sample_rate = static_cast<int64_t>(dec_ctx->sample_rate);
     decoded_duration = av_rescale(total_samples, 1000, sample_rate);
@@ -325,5 +349,5 @@ end:
 
 avpro::CommonMedia::~CommonMedia()
 {
-    avformat_close_input(&fmt_ctx);
+    avpro::close_input(&fmt_ctx);
 }
\ No newline at end of file
@@ -1,6 +1,9 @@
 #ifndef AVPRO_COMMON_H
 #define AVPRO_COMMON_H
 
+#include "io.h"
+#include "pool.h"
+#include "stream_info.h"
 #include <string_view>
 #include <functional>
 #include <memory>
@@ -48,6 +51,9 @@ namespace avpro
         std::string sample_fmt{};
         std::string channel_layout{};
         int decoded_duration{-1};
+        std::shared_ptr<MediaPool> pool{std::make_shared<MediaPool>()};
+        bool fast_open{false};
+        int64_t bytes_used{0};
 
     protected:
         std::unique_ptr<CommonMediaContext> audio_context{nullptr};
@@ -77,8 +83,29 @@ namespace avpro
             return *audio_context;
         }
 
+        /// Share the frame/packet pool of a job, must be set before decoding.
+        void set_pool(std::shared_ptr<MediaPool> media_pool)
+        {
+            pool = std::move(media_pool);
+        }
+
+        MediaPool &get_pool()
+        {
+            return *pool;
+        }
+
+        /// Probe the streams briefly, or reuse the probe of an unchanged
+        /// file, must be set before open_input.
+        void set_fast_open(bool fast)
+        {
+            fast_open = fast;
+        }
+
         int open_input(std::string_view url);
 
+        /// Demux from memory, a mapped file or a descriptor instead of a url.
+        int open_input(const InputSource &source);
+
         int open_audio_stream()
         {
             audio_context = find_stream(AVMediaType::AVMEDIA_TYPE_AUDIO);
@@ -127,6 +154,13 @@ namespace avpro
             return decoded_duration;
         }
 
+        /// Input bytes read against the audio payload sent to the decoder.
+        DemuxStats get_demux_stats()
+        {
+            return DemuxStats{.bytes_read = fmt_ctx ? input_bytes_read(fmt_ctx) : 0,
+                              .bytes_used = bytes_used};
+        }
+
         int get_sample_rate()
         {
             return sample_rate;
@@ -0,0 +1,412 @@
+#include "io.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <filesystem>
+#include <io.h>
+#include <mutex>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+
+namespace avpro {
+
+namespace {
+/// What a context from this file keeps in its opaque pointer.
+struct IoOpaque {
+  virtual ~IoOpaque() = default;
+};
+
+struct OutputOpaque : IoOpaque {
+  OutputSink sink;
+
+  explicit OutputOpaque(OutputSink sink) : sink(std::move(sink)) {}
+};
+
+struct InputOpaque : IoOpaque {
+  InputSource source;
+  int64_t pos{0};
+
+  explicit InputOpaque(InputSource source) : source(std::move(source)) {}
+};
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+using WriteBuffer = const uint8_t *;
+#else
+using WriteBuffer = uint8_t *;
+#endif
+
+int write_packet(void *opaque, WriteBuffer buf, int buf_size) {
+  return static_cast<OutputOpaque *>(opaque)->sink.write(buf, buf_size);
+}
+
+int64_t seek_output(void *opaque, int64_t offset, int whence) {
+  return static_cast<OutputOpaque *>(opaque)->sink.seek(offset,
+                                                        whence & ~AVSEEK_FORCE);
+}
+
+int read_packet(void *opaque, uint8_t *buf, int buf_size) {
+  auto input = static_cast<InputOpaque *>(opaque);
+  const int n = input->source.read_at(input->pos, buf, buf_size);
+  if (n == 0) {
+    return AVERROR_EOF;
+  }
+  if (n > 0) {
+    input->pos += n;
+  }
+  return n;
+}
+
+/// New position of a seek in a stream of size bytes, or a negative AVERROR.
+int64_t seek_position(int64_t pos, int64_t size, int64_t offset,
+                      int whence) {
+  switch (whence) {
+  case SEEK_SET:
+    pos = offset;
+    break;
+  case SEEK_CUR:
+    pos += offset;
+    break;
+  case SEEK_END:
+    pos = size + offset;
+    break;
+  default:
+    return AVERROR(EINVAL);
+  }
+  return pos < 0 ? AVERROR(EINVAL) : pos;
+}
+int64_t seek_input(void *opaque, int64_t offset, int whence) {
+  auto input = static_cast<InputOpaque *>(opaque);
+  whence &= ~AVSEEK_FORCE;
+  if (whence == AVSEEK_SIZE) {
+    return input->source.size;
+  }
+  const int64_t pos =
+      seek_position(input->pos, input->source.size, offset, whence);
+  if (pos >= 0) {
+    input->pos = pos;
+  }
+  return pos;
+}
+} // namespace
+
+OutputSink OutputSink::memory(std::shared_ptr<std::vector<uint8_t>> buffer,
+                              std::string format) {
+  struct State {
+    std::shared_ptr<std::vector<uint8_t>> buffer;
+    std::size_t pos{0};
+  };
+  auto state = std::make_shared<State>();
+  state->buffer = std::move(buffer);
+  state->buffer->clear();
+
+  OutputSink sink;
+  sink.write = [state](const uint8_t *data, int size) {
+    std::vector<uint8_t> &buffer = *state->buffer;
+    if (state->pos + size > buffer.size()) {
+      buffer.resize(state->pos + size);
+    }
+    memcpy(buffer.data() + state->pos, data, size);
+    state->pos += size;
+    return size;
+  };
+  sink.seek = [state](int64_t offset, int whence) -> int64_t {
+    const int64_t size = state->buffer->size();
+    if (whence == AVSEEK_SIZE) {
+      return size;
+    }
+    const int64_t pos = seek_position(state->pos, size, offset, whence);
+    if (pos >= 0) {
+      state->pos = pos;
+    }
+    return pos;
+  };
+  sink.format = std::move(format);
+  return sink;
+}
+
+OutputSink OutputSink::descriptor(int fd, std::string format) {
+  OutputSink sink;
+  sink.write = [fd](const uint8_t *data, int size) {
+    int written = 0;
+    while (written < size) {
+#ifdef _WIN32
+      const int n = _write(fd, data + written, size - written);
+#else
+      const ssize_t n = ::write(fd, data + written, size - written);
+#endif
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return AVERROR(errno);
+      }
+      written += static_cast<int>(n);
+    }
+    return size;
+  };
+
+#ifdef _WIN32
+  const bool seekable = _lseeki64(fd, 0, SEEK_CUR) >= 0;
+#else
+  const bool seekable = lseek(fd, 0, SEEK_CUR) >= 0;
+#endif
+  if (seekable) {
+    sink.seek = [fd](int64_t offset, int whence) -> int64_t {
+      if (whence == AVSEEK_SIZE) {
+#ifdef _WIN32
+        struct _stat64 st;
+        return _fstat64(fd, &st) < 0 ? AVERROR(errno) : st.st_size;
+#else
+        struct stat st;
+        return fstat(fd, &st) < 0 ? AVERROR(errno) : st.st_size;
+#endif
+      }
+#ifdef _WIN32
+      const int64_t pos = _lseeki64(fd, offset, whence);
+#else
+      const int64_t pos = lseek(fd, offset, whence);
+#endif
+      return pos < 0 ? AVERROR(errno) : pos;
+    };
+  }
+  sink.format = std::move(format);
+  return sink;
+}
+
+AVIOContext *open_output_io(OutputSink sink) {
+  const int buffer_size = sink.buffer_size > 0 ? sink.buffer_size : 4096;
+  const bool seekable = static_cast<bool>(sink.seek);
+  unsigned char *buffer;
+  AVIOContext *pb;
+
+  if (!(buffer = static_cast<unsigned char *>(av_malloc(buffer_size)))) {
+    return nullptr;
+  }
+  auto opaque = new OutputOpaque(std::move(sink));
+  if (!(pb = avio_alloc_context(buffer, buffer_size, 1, opaque, NULL,
+                                write_packet,
+                                seekable ? seek_output : NULL))) {
+    av_free(buffer);
+    delete opaque;
+    return nullptr;
+  }
+  pb->seekable = seekable ? AVIO_SEEKABLE_NORMAL : 0;
+  return pb;
+}
+
+InputSource InputSource::memory(const uint8_t *data, std::size_t size,
+                                std::shared_ptr<const void> owner) {
+  InputSource source;
+  source.read_at = [data, size, owner](int64_t offset, uint8_t *buf,
+                                       int buf_size) {
+    if (offset < 0 || static_cast<std::size_t>(offset) >= size) {
+      return 0;
+    }
+    const std::size_t pos = static_cast<std::size_t>(offset);
+    const int n =
+        static_cast<int>(std::min<std::size_t>(buf_size, size - pos));
+    memcpy(buf, data + pos, n);
+    return n;
+  };
+  source.size = static_cast<int64_t>(size);
+  return source;
+}
+
+#ifdef _WIN32
+InputSource InputSource::mapped(const std::string &path) {
+  HANDLE file = CreateFileW(std::filesystem::path(path).wstring().c_str(),
+                            GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  LARGE_INTEGER size;
+  HANDLE mapping = NULL;
+  void *view = NULL;
+
+  if (file == INVALID_HANDLE_VALUE) {
+    return InputSource();
+  }
+  if (GetFileSizeEx(file, &size) && size.QuadPart > 0 &&
+      (mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL))) {
+    view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+  }
+  CloseHandle(file);
+  if (!view) {
+    return size.QuadPart == 0 ? memory(nullptr, 0) : InputSource();
+  }
+
+  std::shared_ptr<const void> owner(
+      view, [](const void *p) { UnmapViewOfFile(p); });
+  return memory(static_cast<const uint8_t *>(view), size.QuadPart,
+                std::move(owner));
+}
+
+InputSource InputSource::descriptor(int fd) {
+  const int64_t size = _lseeki64(fd, 0, SEEK_END);
+  auto mutex = std::make_shared<std::mutex>();
+  InputSource source;
+
+  /* No positional read, seek and read must not interleave between users. */
+  source.read_at = [fd, size, mutex](int64_t offset, uint8_t *buf,
+                                     int buf_size) {
+    std::lock_guard<std::mutex> lock(*mutex);
+    if (size >= 0 && _lseeki64(fd, offset, SEEK_SET) < 0) {
+      return AVERROR(errno);
+    }
+    const int n = _read(fd, buf, buf_size);
+    return n < 0 ? AVERROR(errno) : n;
+  };
+  source.size = size;
+  return source;
+}
+#else
+InputSource InputSource::mapped(const std::string &path) {
+  struct stat st;
+  void *addr;
+
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return InputSource();
+  }
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return InputSource();
+  }
+  const std::size_t size = st.st_size;
+  if (size == 0) {
+    close(fd);
+    return memory(nullptr, 0);
+  }
+  addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  /* The mapping keeps the file referenced. */
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return InputSource();
+  }
+  madvise(addr, size, MADV_SEQUENTIAL);
+
+  std::shared_ptr<const void> owner(addr, [size](const void *p) {
+    munmap(const_cast<void *>(p), size);
+  });
+  return memory(static_cast<const uint8_t *>(addr), size, std::move(owner));
+}
+
+InputSource InputSource::descriptor(int fd) {
+  struct stat st;
+  InputSource source;
+
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    source.read_at = [fd](int64_t offset, uint8_t *buf, int buf_size) {
+      ssize_t n;
+      while ((n = pread(fd, buf, buf_size, offset)) < 0 && errno == EINTR) {
+      }
+      return n < 0 ? AVERROR(errno) : static_cast<int>(n);
+    };
+    source.size = st.st_size;
+  } else {
+    /* Pipes and sockets are read in order, the demuxer never seeks. */
+    source.read_at = [fd](int64_t, uint8_t *buf, int buf_size) {
+      ssize_t n;
+      while ((n = read(fd, buf, buf_size)) < 0 && errno == EINTR) {
+      }
+      return n < 0 ? AVERROR(errno) : static_cast<int>(n);
+    };
+  }
+  return source;
+}
+#endif
+
+AVIOContext *open_input_io(InputSource source) {
+  const int buffer_size = source.read_size > 0 ? source.read_size : 4096;
+  const bool seekable = source.size >= 0;
+  unsigned char *buffer;
+  AVIOContext *pb;
+
+  if (!(buffer = static_cast<unsigned char *>(av_malloc(buffer_size)))) {
+    return nullptr;
+  }
+  auto opaque = new InputOpaque(std::move(source));
+  if (!(pb = avio_alloc_context(buffer, buffer_size, 0, opaque, read_packet,
+                                NULL, seekable ? seek_input : NULL))) {
+    av_free(buffer);
+    delete opaque;
+    return nullptr;
+  }
+  pb->seekable = seekable ? AVIO_SEEKABLE_NORMAL : 0;
+  return pb;
+}
+
+int open_input(AVFormatContext **input_format_context, const char *url,
+               const InputSource *source) {
+  const AVInputFormat *format = NULL;
+  AVIOContext *pb;
+  int error;
+
+  if (!source) {
+    return avformat_open_input(input_format_context, url, NULL, NULL);
+  }
+  if (!source->format.empty() &&
+      !(format = av_find_input_format(source->format.c_str()))) {
+    return AVERROR_DEMUXER_NOT_FOUND;
+  }
+  if (!(*input_format_context = avformat_alloc_context())) {
+    return AVERROR(ENOMEM);
+  }
+  if (!(pb = open_input_io(*source))) {
+    avformat_free_context(*input_format_context);
+    *input_format_context = NULL;
+    return AVERROR(ENOMEM);
+  }
+  (*input_format_context)->pb = pb;
+  (*input_format_context)->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+  /* The context is freed on failure, the custom I/O is left to us. */
+  if ((error = avformat_open_input(input_format_context, url ? url : "",
+                                   format, NULL)) < 0) {
+    close_io(&pb);
+  }
+  return error;
+}
+
+void close_input(AVFormatContext **input_format_context) {
+  AVIOContext *pb = NULL;
+
+  if (!*input_format_context) {
+    return;
+  }
+  if ((*input_format_context)->flags & AVFMT_FLAG_CUSTOM_IO) {
+    pb = (*input_format_context)->pb;
+  }
+  avformat_close_input(input_format_context);
+  close_io(&pb);
+}
+
+void close_io(AVIOContext **pb) {
+  if (!*pb) {
+    return;
+  }
+  if ((*pb)->write_flag) {
+    avio_flush(*pb);
+  }
+  delete static_cast<IoOpaque *>((*pb)->opaque);
+  av_freep(&(*pb)->buffer);
+  avio_context_free(pb);
+}
+
+} // namespace avpro
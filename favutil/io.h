@@ -0,0 +1,89 @@
+#ifndef AVPRO_IO_H
+#define AVPRO_IO_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavformat/avio.h>
+}
+
+namespace avpro {
+
+/// Destination of a muxer other than a file path, e.g. an upload stream.
+struct OutputSink {
+  /// Takes the muxed bytes in order. Returns size, or a negative AVERROR.
+  std::function<int(const uint8_t *data, int size)> write;
+  /// Moves the write position like lseek, whence may also be AVSEEK_SIZE.
+  /// Empty for pipes and sockets: muxers that seek back to finish the file
+  /// then write their streamable variant (fragmented MP4) or fail.
+  std::function<int64_t(int64_t offset, int whence)> seek;
+  /// muxer short name ("adts", "mp3", "ipod", ...), empty to guess it from
+  /// the file name
+  std::string format;
+  /// bytes collected before each write call
+  int buffer_size{64 * 1024};
+
+  /// Seekable sink that replaces the contents of buffer with the file.
+  static OutputSink memory(std::shared_ptr<std::vector<uint8_t>> buffer,
+                           std::string format);
+
+  /// Writes to an open descriptor, e.g. 1 for stdout. Seekable only if the
+  /// descriptor is; the descriptor stays open.
+  static OutputSink descriptor(int fd, std::string format);
+};
+
+/// Source of a demuxer other than a path: bytes already in memory, a mapped
+/// file or an open descriptor. Reads are positional, so one source can back
+/// several demuxers at once (e.g. the slices of a sliced decoder).
+struct InputSource {
+  /// Reads up to size bytes at offset. Returns the bytes read, 0 at the end,
+  /// or a negative AVERROR.
+  std::function<int(int64_t offset, uint8_t *data, int size)> read_at;
+  /// total bytes, -1 if unknown (pipe); the demuxer cannot seek then
+  int64_t size{-1};
+  /// demuxer short name, empty to probe the content
+  std::string format;
+  /// bytes the demuxer reads per call
+  int read_size{64 * 1024};
+
+  explicit operator bool() const { return static_cast<bool>(read_at); }
+
+  /// Reads size bytes at data, which must stay valid while the source is
+  /// used unless owner keeps them alive.
+  static InputSource memory(const uint8_t *data, std::size_t size,
+                            std::shared_ptr<const void> owner = nullptr);
+
+  /// Maps the file read-only with a sequential access hint. Empty if the
+  /// file cannot be mapped.
+  static InputSource mapped(const std::string &path);
+
+  /// Reads an open descriptor with a sequential access hint; a pipe is read
+  /// in order without seeking. The descriptor stays open.
+  static InputSource descriptor(int fd);
+};
+
+/// AVIOContext writing into sink, release it with close_io.
+AVIOContext *open_output_io(OutputSink sink);
+
+/// AVIOContext reading from source, release it with close_io.
+AVIOContext *open_input_io(InputSource source);
+
+/// Flushes a context from open_output_io or open_input_io and frees it and
+/// its sink or source.
+void close_io(AVIOContext **pb);
+
+/// avformat_open_input on url, or on source if given. Release the context
+/// with close_input, which also frees the source's AVIOContext.
+int open_input(AVFormatContext **input_format_context, const char *url,
+               const InputSource *source = nullptr);
+
+void close_input(AVFormatContext **input_format_context);
+
+} // namespace avpro
+
+#endif
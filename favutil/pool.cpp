@@ -0,0 +1,176 @@
+#include "pool.h"
+#include <algorithm>
+
+static int frame_capacity(const AVFrame *frame) {
+  const AVSampleFormat sample_fmt = static_cast<AVSampleFormat>(frame->format);
+  int bytes = av_get_bytes_per_sample(sample_fmt);
+  if (!av_sample_fmt_is_planar(sample_fmt))
+    bytes *= frame->ch_layout.nb_channels;
+  return bytes > 0 ? frame->linesize[0] / bytes : 0;
+}
+
+static bool can_reuse(const AVFrame *frame, const AVChannelLayout *ch_layout,
+                      AVSampleFormat sample_fmt, int nb_samples) {
+  return frame->buf[0] && frame->format == sample_fmt &&
+         !av_channel_layout_compare(&frame->ch_layout, ch_layout) &&
+         frame_capacity(frame) >= nb_samples;
+}
+
+AVFrame *avpro::MediaPool::acquire_frame() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.frame_acquires;
+  if (!frames_.empty()) {
+    AVFrame *frame = frames_.back();
+    frames_.pop_back();
+    av_frame_unref(frame);
+    return frame;
+  }
+  ++stats_.frame_allocs;
+  return av_frame_alloc();
+}
+
+AVFrame *avpro::MediaPool::acquire_audio_frame(const AVChannelLayout *ch_layout,
+                                               AVSampleFormat sample_fmt,
+                                               int sample_rate,
+                                               int nb_samples) {
+  AVFrame *frame = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.frame_acquires;
+    ++stats_.sample_acquires;
+    auto it = std::find_if(frames_.begin(), frames_.end(), [&](AVFrame *f) {
+      return can_reuse(f, ch_layout, sample_fmt, nb_samples);
+    });
+    if (it == frames_.end() && !frames_.empty())
+      it = frames_.end() - 1;
+    if (it != frames_.end()) {
+      frame = *it;
+      frames_.erase(it);
+    } else {
+      ++stats_.frame_allocs;
+      frame = av_frame_alloc();
+    }
+  }
+  if (!frame)
+    return nullptr;
+
+  /* The buffers may still be referenced by an encoder, av_frame_make_writable
+   * only copies in that case. */
+  if (can_reuse(frame, ch_layout, sample_fmt, nb_samples) &&
+      av_frame_make_writable(frame) >= 0) {
+    frame->nb_samples = nb_samples;
+    frame->sample_rate = sample_rate;
+    frame->pts = AV_NOPTS_VALUE;
+    return frame;
+  }
+
+  av_frame_unref(frame);
+  frame->nb_samples = nb_samples;
+  frame->format = sample_fmt;
+  frame->sample_rate = sample_rate;
+  if (av_channel_layout_copy(&frame->ch_layout, ch_layout) < 0 ||
+      av_frame_get_buffer(frame, 0) < 0) {
+    av_frame_free(&frame);
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.sample_allocs;
+  return frame;
+}
+
+void avpro::MediaPool::release_frame(AVFrame *frame) {
+  if (!frame)
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  frames_.push_back(frame);
+}
+
+AVPacket *avpro::MediaPool::acquire_packet() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.packet_acquires;
+  if (!packets_.empty()) {
+    AVPacket *packet = packets_.back();
+    packets_.pop_back();
+    return packet;
+  }
+  ++stats_.packet_allocs;
+  return av_packet_alloc();
+}
+
+void avpro::MediaPool::release_packet(AVPacket *packet) {
+  if (!packet)
+    return;
+  av_packet_unref(packet);
+  std::lock_guard<std::mutex> lock(mutex_);
+  packets_.push_back(packet);
+}
+
+avpro::PooledSamples avpro::MediaPool::acquire_samples(
+    int nb_channels, int nb_samples, AVSampleFormat sample_fmt) {
+  PooledSamples samples;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.sample_acquires;
+    auto same_format = [&](const PooledSamples &s) {
+      return s.nb_channels == nb_channels && s.sample_fmt == sample_fmt;
+    };
+    auto it = std::find_if(
+        samples_.begin(), samples_.end(), [&](const PooledSamples &s) {
+          return same_format(s) && s.nb_samples >= nb_samples;
+        });
+    if (it == samples_.end()) {
+      /* Replace a buffer that became too small instead of keeping both. */
+      it = std::find_if(samples_.begin(), samples_.end(), same_format);
+      if (it != samples_.end()) {
+        av_freep(&it->data[0]);
+        delete[] it->data;
+        samples_.erase(it);
+      }
+      ++stats_.sample_allocs;
+    } else {
+      samples = *it;
+      samples_.erase(it);
+      return samples;
+    }
+  }
+
+  /* Size new buffers to the stream, not to the first request. */
+  samples.nb_channels = nb_channels;
+  samples.nb_samples = std::max(nb_samples, 1024);
+  samples.sample_fmt = sample_fmt;
+  samples.data = new uint8_t *[std::max(nb_channels, 1)];
+  if (av_samples_alloc(samples.data, NULL, nb_channels, samples.nb_samples,
+                       sample_fmt, 0) < 0) {
+    delete[] samples.data;
+    samples.data = nullptr;
+  }
+  return samples;
+}
+
+void avpro::MediaPool::release_samples(PooledSamples &samples) {
+  if (!samples.data)
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  samples_.push_back(samples);
+  samples.data = nullptr;
+}
+
+avpro::MediaPoolStats avpro::MediaPool::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  MediaPoolStats stats = stats_;
+  stats.elapsed_seconds = std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - created_)
+                              .count();
+  return stats;
+}
+
+avpro::MediaPool::~MediaPool() {
+  for (AVFrame *frame : frames_)
+    av_frame_free(&frame);
+  for (AVPacket *packet : packets_)
+    av_packet_free(&packet);
+  for (PooledSamples &samples : samples_) {
+    av_freep(&samples.data[0]);
+    delete[] samples.data;
+  }
+}
@@ -0,0 +1,98 @@
+#ifndef AVPRO_POOL_H
+#define AVPRO_POOL_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/frame.h>
+#include <libavutil/samplefmt.h>
+}
+
+namespace avpro {
+
+/// Counters of a MediaPool. acquires is what an unpooled code path would
+/// allocate, allocs is what the pool really allocated.
+struct MediaPoolStats {
+  int64_t frame_acquires{0};
+  int64_t frame_allocs{0};
+  int64_t packet_acquires{0};
+  int64_t packet_allocs{0};
+  int64_t sample_acquires{0};
+  int64_t sample_allocs{0};
+  double elapsed_seconds{0};
+
+  int64_t acquires() const {
+    return frame_acquires + packet_acquires + sample_acquires;
+  }
+
+  int64_t allocs() const { return frame_allocs + packet_allocs + sample_allocs; }
+
+  double acquires_per_second() const {
+    return elapsed_seconds > 0 ? acquires() / elapsed_seconds : 0;
+  }
+
+  double allocs_per_second() const {
+    return elapsed_seconds > 0 ? allocs() / elapsed_seconds : 0;
+  }
+};
+
+/// Sample buffer handed out by MediaPool, laid out like av_samples_alloc.
+struct PooledSamples {
+  uint8_t **data{nullptr};
+  int nb_channels{0};
+  int nb_samples{0};
+  AVSampleFormat sample_fmt{AV_SAMPLE_FMT_NONE};
+};
+
+/// Per-job recycler of AVFrames, AVPackets and sample buffers. Released
+/// objects are kept and handed out again instead of going back to the
+/// allocator. All methods are thread-safe.
+class MediaPool {
+  mutable std::mutex mutex_;
+  std::vector<AVFrame *> frames_;
+  std::vector<AVPacket *> packets_;
+  std::vector<PooledSamples> samples_;
+  MediaPoolStats stats_;
+  std::chrono::steady_clock::time_point created_{
+      std::chrono::steady_clock::now()};
+
+public:
+  MediaPool() = default;
+
+  MediaPool(const MediaPool &) = delete;
+
+  MediaPool &operator=(const MediaPool &) = delete;
+
+  /// Frame without buffers, e.g. for avcodec_receive_frame.
+  AVFrame *acquire_frame();
+
+  /// Frame with writable buffers for nb_samples samples. Buffers of a
+  /// released frame with the same format are reused when large enough.
+  AVFrame *acquire_audio_frame(const AVChannelLayout *ch_layout,
+                               AVSampleFormat sample_fmt, int sample_rate,
+                               int nb_samples);
+
+  void release_frame(AVFrame *frame);
+
+  AVPacket *acquire_packet();
+
+  void release_packet(AVPacket *packet);
+
+  /// Buffer holding at least nb_samples samples, data is NULL on failure.
+  PooledSamples acquire_samples(int nb_channels, int nb_samples,
+                                AVSampleFormat sample_fmt);
+
+  void release_samples(PooledSamples &samples);
+
+  MediaPoolStats stats() const;
+
+  ~MediaPool();
+};
+} // namespace avpro
+
+#endif
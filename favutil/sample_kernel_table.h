@@ -0,0 +1,47 @@
+#ifndef AVPRO_SAMPLE_KERNEL_TABLE_H
+#define AVPRO_SAMPLE_KERNEL_TABLE_H
+
+// Declarations only. The per instruction set units include this rather than
+// sample_kernels.h, so that they define no inline function the generic code
+// could link against.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace avpro {
+namespace kernels {
+
+enum class Isa { kScalar, kSse2, kAvx2, kAvx512 };
+
+/// One implementation of every sample loop. Counts are in samples, all
+/// channels together, unless they are called frames. Pointers need no
+/// alignment, and dst may equal src for the element-wise kernels.
+struct KernelTable {
+  Isa isa;
+  /// dst[i] = src[i] * gain
+  void (*gain)(float *dst, const float *src, std::size_t n, float gain);
+  /// dst[i] += src[i] * gain
+  void (*mix)(float *dst, const float *src, std::size_t n, float gain);
+  /// dst fades linearly from a to b over nb_frames interleaved frames
+  void (*crossfade)(float *dst, const float *a, const float *b,
+                    std::size_t nb_frames, int nb_channels);
+  /// planar stereo to interleaved
+  void (*interleave2)(float *dst, const float *left, const float *right,
+                      std::size_t nb_frames);
+  /// interleaved stereo to planar
+  void (*deinterleave2)(float *left, float *right, const float *src,
+                        std::size_t nb_frames);
+  /// rounded to nearest and saturated, 1.0 maps to 32767
+  void (*float_to_s16)(int16_t *dst, const float *src, std::size_t n);
+  void (*s16_to_float)(float *dst, const int16_t *src, std::size_t n);
+  /// largest absolute value
+  float (*peak)(const float *src, std::size_t n);
+  double (*sum_squares)(const float *src, std::size_t n);
+  double (*abs_sum)(const float *src, std::size_t n);
+  int64_t (*abs_sum_s16)(const int16_t *src, std::size_t n);
+};
+
+} // namespace kernels
+} // namespace avpro
+
+#endif
@@ -0,0 +1,251 @@
+#include "sample_kernels.h"
+#include "sample_kernels_impl.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if AVPRO_KERNELS_X86 && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace avpro {
+namespace kernels {
+
+#if AVPRO_KERNELS_X86
+const KernelTable *sse2_kernels();
+const KernelTable *avx2_kernels();
+const KernelTable *avx512_kernels();
+#endif
+
+namespace {
+
+/* The reference every vector implementation is checked against, and the
+ * fallback on other architectures. */
+struct Scalar {
+  static void gain(float *dst, const float *src, std::size_t n, float g) {
+    for (std::size_t i = 0; i < n; ++i) {
+      dst[i] = src[i] * g;
+    }
+  }
+
+  static void mix(float *dst, const float *src, std::size_t n, float g) {
+    for (std::size_t i = 0; i < n; ++i) {
+      dst[i] += src[i] * g;
+    }
+  }
+
+  static void crossfade(float *dst, const float *a, const float *b,
+                        std::size_t nb_frames, int nb_channels) {
+    const float step = nb_frames ? 1.0f / nb_frames : 0.0f;
+    for (std::size_t i = 0; i < nb_frames; ++i) {
+      const float t = static_cast<float>(i) * step;
+      for (int c = 0; c < nb_channels; ++c) {
+        const std::size_t k = i * nb_channels + c;
+        dst[k] = a[k] + (b[k] - a[k]) * t;
+      }
+    }
+  }
+
+  static void interleave2(float *dst, const float *left, const float *right,
+                          std::size_t nb_frames) {
+    for (std::size_t i = 0; i < nb_frames; ++i) {
+      dst[2 * i] = left[i];
+      dst[2 * i + 1] = right[i];
+    }
+  }
+
+  static void deinterleave2(float *left, float *right, const float *src,
+                            std::size_t nb_frames) {
+    for (std::size_t i = 0; i < nb_frames; ++i) {
+      left[i] = src[2 * i];
+      right[i] = src[2 * i + 1];
+    }
+  }
+
+  static void float_to_s16(int16_t *dst, const float *src, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+      dst[i] = detail::to_s16(src[i]);
+    }
+  }
+
+  static void s16_to_float(float *dst, const int16_t *src, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+      dst[i] = src[i] * (1.0f / 32768.0f);
+    }
+  }
+
+  static float peak(const float *src, std::size_t n) {
+    float result = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      result = std::max(result, std::fabs(src[i]));
+    }
+    return result;
+  }
+
+  static double sum_squares(const float *src, std::size_t n) {
+    double total = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      total += static_cast<double>(src[i]) * src[i];
+    }
+    return total;
+  }
+
+  static double abs_sum(const float *src, std::size_t n) {
+    double total = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      total += std::fabs(src[i]);
+    }
+    return total;
+  }
+
+  static int64_t abs_sum_s16(const int16_t *src, std::size_t n) {
+    int64_t total = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      total += std::abs(static_cast<int>(src[i]));
+    }
+    return total;
+  }
+};
+
+const KernelTable kScalarTable{
+    Isa::kScalar,         Scalar::gain,         Scalar::mix,
+    Scalar::crossfade,    Scalar::interleave2,  Scalar::deinterleave2,
+    Scalar::float_to_s16, Scalar::s16_to_float, Scalar::peak,
+    Scalar::sum_squares,  Scalar::abs_sum,      Scalar::abs_sum_s16};
+
+#if AVPRO_KERNELS_X86 && defined(_MSC_VER)
+bool msvc_cpu_supports(Isa isa) {
+  int info[4];
+  __cpuid(info, 1);
+  const bool sse2 = info[3] & (1 << 26);
+  const bool fma = info[2] & (1 << 12);
+  const bool osxsave = info[2] & (1 << 27);
+  if (isa == Isa::kSse2) {
+    return sse2;
+  }
+  /* The OS has to save the wide registers on context switches. */
+  const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+  __cpuidex(info, 7, 0);
+  if (isa == Isa::kAvx2) {
+    return fma && (info[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6;
+  }
+  return (info[1] & (1 << 16)) && (info[1] & (1 << 30)) &&
+         (xcr0 & 0xe6) == 0xe6;
+}
+#endif
+
+bool cpu_supports(Isa isa) {
+  switch (isa) {
+  case Isa::kScalar:
+    return true;
+#if AVPRO_KERNELS_X86 && defined(_MSC_VER)
+  case Isa::kSse2:
+  case Isa::kAvx2:
+  case Isa::kAvx512:
+    return msvc_cpu_supports(isa);
+#elif AVPRO_KERNELS_X86
+  case Isa::kSse2:
+    return __builtin_cpu_supports("sse2");
+  case Isa::kAvx2:
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  case Isa::kAvx512:
+    return __builtin_cpu_supports("avx512f") &&
+           __builtin_cpu_supports("avx512bw");
+#endif
+  default:
+    return false;
+  }
+}
+
+const KernelTable &select_kernels() {
+  Isa limit = Isa::kAvx512;
+  if (const char *env = std::getenv("AVPRO_KERNELS")) {
+    for (Isa isa : {Isa::kScalar, Isa::kSse2, Isa::kAvx2, Isa::kAvx512}) {
+      if (strcmp(env, isa_name(isa)) == 0) {
+        limit = isa;
+      }
+    }
+  }
+  for (Isa isa : {Isa::kAvx512, Isa::kAvx2, Isa::kSse2}) {
+    const KernelTable *table;
+    if (isa <= limit && (table = kernels_for(isa))) {
+      return *table;
+    }
+  }
+  return kScalarTable;
+}
+
+} // namespace
+
+const KernelTable *kernels_for(Isa isa) {
+  if (!cpu_supports(isa)) {
+    return nullptr;
+  }
+  switch (isa) {
+  case Isa::kScalar:
+    return &kScalarTable;
+#if AVPRO_KERNELS_X86
+  case Isa::kSse2:
+    return sse2_kernels();
+  case Isa::kAvx2:
+    return avx2_kernels();
+  case Isa::kAvx512:
+    return avx512_kernels();
+#endif
+  default:
+    return nullptr;
+  }
+}
+
+const KernelTable &kernels() {
+  static const KernelTable &table = select_kernels();
+  return table;
+}
+
+const char *isa_name(Isa isa) {
+  switch (isa) {
+  case Isa::kSse2:
+    return "sse2";
+  case Isa::kAvx2:
+    return "avx2";
+  case Isa::kAvx512:
+    return "avx512";
+  default:
+    return "scalar";
+  }
+}
+
+void interleave(float *dst, const float *const *src, int nb_channels,
+                std::size_t nb_frames) {
+  if (nb_channels == 2) {
+    kernels().interleave2(dst, src[0], src[1], nb_frames);
+  } else if (nb_channels == 1) {
+    memcpy(dst, src[0], nb_frames * sizeof(float));
+  } else {
+    for (std::size_t i = 0; i < nb_frames; ++i) {
+      for (int c = 0; c < nb_channels; ++c) {
+        *dst++ = src[c][i];
+      }
+    }
+  }
+}
+
+void deinterleave(float *const *dst, const float *src, int nb_channels,
+                  std::size_t nb_frames) {
+  if (nb_channels == 2) {
+    kernels().deinterleave2(dst[0], dst[1], src, nb_frames);
+  } else if (nb_channels == 1) {
+    memcpy(dst[0], src, nb_frames * sizeof(float));
+  } else {
+    for (std::size_t i = 0; i < nb_frames; ++i) {
+      for (int c = 0; c < nb_channels; ++c) {
+        dst[c][i] = *src++;
+      }
+    }
+  }
+}
+
+} // namespace kernels
+} // namespace avpro
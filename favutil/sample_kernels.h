@@ -0,0 +1,69 @@
+#ifndef AVPRO_SAMPLE_KERNELS_H
+#define AVPRO_SAMPLE_KERNELS_H
+
+#include "sample_kernel_table.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace avpro {
+namespace kernels {
+
+/// Best table the build and the CPU support, chosen on first use. Setting
+/// AVPRO_KERNELS to scalar, sse2, avx2 or avx512 caps the choice.
+const KernelTable &kernels();
+
+/// Table of one instruction set, nullptr if the build or the CPU lacks it.
+const KernelTable *kernels_for(Isa isa);
+
+const char *isa_name(Isa isa);
+
+inline void gain(float *dst, const float *src, std::size_t n, float g) {
+  kernels().gain(dst, src, n, g);
+}
+
+inline void mix(float *dst, const float *src, std::size_t n, float g) {
+  kernels().mix(dst, src, n, g);
+}
+
+inline void crossfade(float *dst, const float *a, const float *b,
+                      std::size_t nb_frames, int nb_channels) {
+  kernels().crossfade(dst, a, b, nb_frames, nb_channels);
+}
+
+/// Planar to interleaved for any channel count, vectorized for stereo.
+void interleave(float *dst, const float *const *src, int nb_channels,
+                std::size_t nb_frames);
+
+/// Interleaved to planar for any channel count, vectorized for stereo.
+void deinterleave(float *const *dst, const float *src, int nb_channels,
+                  std::size_t nb_frames);
+
+inline void float_to_s16(int16_t *dst, const float *src, std::size_t n) {
+  kernels().float_to_s16(dst, src, n);
+}
+
+inline void s16_to_float(float *dst, const int16_t *src, std::size_t n) {
+  kernels().s16_to_float(dst, src, n);
+}
+
+inline float peak(const float *src, std::size_t n) {
+  return kernels().peak(src, n);
+}
+
+inline double rms(const float *src, std::size_t n) {
+  return n ? std::sqrt(kernels().sum_squares(src, n) / n) : 0;
+}
+
+inline double abs_sum(const float *src, std::size_t n) {
+  return kernels().abs_sum(src, n);
+}
+
+inline int64_t abs_sum_s16(const int16_t *src, std::size_t n) {
+  return kernels().abs_sum_s16(src, n);
+}
+
+} // namespace kernels
+} // namespace avpro
+
+#endif
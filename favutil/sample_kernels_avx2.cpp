@@ -0,0 +1,105 @@
+#include "sample_kernels_impl.h"
+#include <immintrin.h>
+
+namespace avpro {
+namespace kernels {
+namespace {
+
+struct Avx2 {
+  using F = __m256;
+  using I = __m256i;
+  static constexpr std::size_t kWidth = 8;
+
+  static F load(const float *p) { return _mm256_loadu_ps(p); }
+  static void store(float *p, F v) { _mm256_storeu_ps(p, v); }
+  static F set1(float x) { return _mm256_set1_ps(x); }
+  static F add(F a, F b) { return _mm256_add_ps(a, b); }
+  static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+  static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+  static F madd(F a, F b, F c) { return _mm256_fmadd_ps(a, b, c); }
+  static F max(F a, F b) { return _mm256_max_ps(a, b); }
+  static F abs(F v) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v); }
+
+  static float hmax(F v) {
+    __m128 m = _mm_max_ps(_mm256_castps256_ps128(v),
+                          _mm256_extractf128_ps(v, 1));
+    m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+    return _mm_cvtss_f32(m);
+  }
+
+  static float hsum(F v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v),
+                          _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+  }
+
+  static void interleave2(float *dst, const float *left, const float *right) {
+    const F l = load(left);
+    const F r = load(right);
+    /* unpack works within 128-bit lanes, the permutes put the halves back
+     * into frame order. */
+    const F lo = _mm256_unpacklo_ps(l, r);
+    const F hi = _mm256_unpackhi_ps(l, r);
+    store(dst, _mm256_permute2f128_ps(lo, hi, 0x20));
+    store(dst + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+  }
+
+  static void deinterleave2(float *left, float *right, const float *src) {
+    const F a = load(src);
+    const F b = load(src + 8);
+    const F l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+    const F r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+    store(left, _mm256_castpd_ps(_mm256_permute4x64_pd(
+                    _mm256_castps_pd(l), _MM_SHUFFLE(3, 1, 2, 0))));
+    store(right, _mm256_castpd_ps(_mm256_permute4x64_pd(
+                     _mm256_castps_pd(r), _MM_SHUFFLE(3, 1, 2, 0))));
+  }
+
+  static void to_s16(int16_t *dst, const float *src) {
+    F x = _mm256_mul_ps(load(src), _mm256_set1_ps(32768.0f));
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-32768.0f)),
+                      _mm256_set1_ps(32767.0f));
+    const I i = _mm256_cvtps_epi32(x);
+    const __m128i s = _mm_packs_epi32(_mm256_castsi256_si128(i),
+                                      _mm256_extracti128_si256(i, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), s);
+  }
+
+  static void from_s16(float *dst, const int16_t *src) {
+    const I i = _mm256_cvtepi16_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src)));
+    store(dst,
+          _mm256_mul_ps(_mm256_cvtepi32_ps(i), set1(1.0f / 32768.0f)));
+  }
+
+  static I zero_i() { return _mm256_setzero_si256(); }
+
+  static I abs_s16_add(I acc, const int16_t *src) {
+    const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+    /* |-32768| wraps to 0x8000, which is right once read as unsigned. */
+    return _mm256_add_epi32(acc, _mm256_cvtepu16_epi32(_mm_abs_epi16(s)));
+  }
+
+  static int64_t hsum_i(I v) {
+    alignas(32) int32_t lanes[8];
+    _mm256_store_si256(reinterpret_cast<I *>(lanes), v);
+    int64_t total = 0;
+    for (int32_t lane : lanes) {
+      total += lane;
+    }
+    return total;
+  }
+};
+
+} // namespace
+
+const KernelTable *avx2_kernels() {
+  static const KernelTable table = detail::Kernels<Avx2>::table(Isa::kAvx2);
+  return &table;
+}
+
+} // namespace kernels
+} // namespace avpro
@@ -0,0 +1,81 @@
+#include "sample_kernels_impl.h"
+#include <immintrin.h>
+
+namespace avpro {
+namespace kernels {
+namespace {
+
+struct Avx512 {
+  using F = __m512;
+  using I = __m512i;
+  static constexpr std::size_t kWidth = 16;
+
+  static F load(const float *p) { return _mm512_loadu_ps(p); }
+  static void store(float *p, F v) { _mm512_storeu_ps(p, v); }
+  static F set1(float x) { return _mm512_set1_ps(x); }
+  static F add(F a, F b) { return _mm512_add_ps(a, b); }
+  static F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+  static F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+  static F madd(F a, F b, F c) { return _mm512_fmadd_ps(a, b, c); }
+  static F max(F a, F b) { return _mm512_max_ps(a, b); }
+  static F abs(F v) { return _mm512_abs_ps(v); }
+  static float hmax(F v) { return _mm512_reduce_max_ps(v); }
+  static float hsum(F v) { return _mm512_reduce_add_ps(v); }
+
+  static void interleave2(float *dst, const float *left, const float *right) {
+    const F l = load(left);
+    const F r = load(right);
+    const I lo = _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21,
+                                   6, 22, 7, 23);
+    const I hi = _mm512_setr_epi32(8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13,
+                                   29, 14, 30, 15, 31);
+    store(dst, _mm512_permutex2var_ps(l, lo, r));
+    store(dst + 16, _mm512_permutex2var_ps(l, hi, r));
+  }
+
+  static void deinterleave2(float *left, float *right, const float *src) {
+    const F a = load(src);
+    const F b = load(src + 16);
+    const I even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20,
+                                     22, 24, 26, 28, 30);
+    const I odd = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23,
+                                    25, 27, 29, 31);
+    store(left, _mm512_permutex2var_ps(a, even, b));
+    store(right, _mm512_permutex2var_ps(a, odd, b));
+  }
+
+  static void to_s16(int16_t *dst, const float *src) {
+    F x = _mm512_mul_ps(load(src), set1(32768.0f));
+    x = _mm512_min_ps(_mm512_max_ps(x, set1(-32768.0f)), set1(32767.0f));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst),
+                        _mm512_cvtsepi32_epi16(_mm512_cvtps_epi32(x)));
+  }
+
+  static void from_s16(float *dst, const int16_t *src) {
+    const I i = _mm512_cvtepi16_epi32(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)));
+    store(dst, _mm512_mul_ps(_mm512_cvtepi32_ps(i), set1(1.0f / 32768.0f)));
+  }
+
+  static I zero_i() { return _mm512_setzero_si512(); }
+
+  static I abs_s16_add(I acc, const int16_t *src) {
+    const __m256i s =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+    /* |-32768| wraps to 0x8000, which is right once read as unsigned. */
+    return _mm512_add_epi32(acc, _mm512_cvtepu16_epi32(_mm256_abs_epi16(s)));
+  }
+
+  static int64_t hsum_i(I v) { return _mm512_reduce_add_epi32(v); }
+};
+
+} // namespace
+
+const KernelTable *avx512_kernels() {
+  static const KernelTable table =
+      detail::Kernels<Avx512>::table(Isa::kAvx512);
+  return &table;
+}
+
+} // namespace kernels
+} // namespace avpro
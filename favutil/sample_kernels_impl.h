@@ -0,0 +1,218 @@
+#ifndef AVPRO_SAMPLE_KERNELS_IMPL_H
+#define AVPRO_SAMPLE_KERNELS_IMPL_H
+
+// Loop bodies shared by the per instruction set translation units. Each of
+// them includes this header with its own vector traits V:
+//   F, I                       float and int32 vector types, kWidth lanes
+//   load, store, set1, add, sub, mul, madd(a, b, c) = a * b + c, max, abs
+//   hmax, hsum                 horizontal reductions of F
+//   interleave2, deinterleave2 kWidth stereo frames
+//   to_s16, from_s16           kWidth samples
+//   zero_i, abs_s16_add, hsum_i kWidth int16 samples summed into int32 lanes
+//
+// Everything here has internal linkage and calls no inline function of the
+// standard library: those are emitted once per unit with that unit's flags,
+// and the linker would keep an arbitrary copy, maybe an AVX-512 one for the
+// scalar path.
+
+#include "sample_kernel_table.h"
+#include <cstddef>
+#include <cstdint>
+#include <math.h>
+#include <stdlib.h>
+
+namespace avpro {
+namespace kernels {
+namespace detail {
+namespace {
+
+/// Samples summed in vector lanes before they are folded into the wider
+/// scalar total, small enough that no lane loses precision or overflows.
+constexpr std::size_t kFloatBlock = 4096;
+constexpr std::size_t kS16Block = 32768;
+
+template <typename T> T min_of(T a, T b) { return b < a ? b : a; }
+
+template <typename T> T max_of(T a, T b) { return a < b ? b : a; }
+
+int16_t to_s16(float x) {
+  x = min_of(max_of(x * 32768.0f, -32768.0f), 32767.0f);
+  return static_cast<int16_t>(lrintf(x));
+}
+
+template <typename V> struct Kernels {
+  static constexpr std::size_t W = V::kWidth;
+
+  static void gain(float *dst, const float *src, std::size_t n, float g) {
+    const auto vg = V::set1(g);
+    std::size_t i = 0;
+    for (; i + W <= n; i += W) {
+      V::store(dst + i, V::mul(V::load(src + i), vg));
+    }
+    for (; i < n; ++i) {
+      dst[i] = src[i] * g;
+    }
+  }
+
+  static void mix(float *dst, const float *src, std::size_t n, float g) {
+    const auto vg = V::set1(g);
+    std::size_t i = 0;
+    for (; i + W <= n; i += W) {
+      V::store(dst + i, V::madd(V::load(src + i), vg, V::load(dst + i)));
+    }
+    for (; i < n; ++i) {
+      dst[i] += src[i] * g;
+    }
+  }
+
+  static void crossfade(float *dst, const float *a, const float *b,
+                        std::size_t nb_frames, int nb_channels) {
+    const std::size_t n = nb_frames * nb_channels;
+    const float step = nb_frames ? 1.0f / nb_frames : 0.0f;
+    std::size_t i = 0;
+
+    /* A vector spans whole frames when the channel count divides the width,
+     * then the ramp of every vector is a fixed lane pattern plus a base. */
+    if (nb_channels > 0 && W % nb_channels == 0) {
+      alignas(64) float lanes[W];
+      for (std::size_t j = 0; j < W; ++j) {
+        lanes[j] = static_cast<float>(j / nb_channels);
+      }
+      const auto vlanes = V::load(lanes);
+      const auto vstep = V::set1(step);
+      for (; i + W <= n; i += W) {
+        const auto base = V::set1(static_cast<float>(i / nb_channels));
+        const auto t = V::mul(V::add(base, vlanes), vstep);
+        const auto va = V::load(a + i);
+        V::store(dst + i, V::madd(V::sub(V::load(b + i), va), t, va));
+      }
+    }
+    for (; i < n; ++i) {
+      const float t = static_cast<float>(i / nb_channels) * step;
+      dst[i] = a[i] + (b[i] - a[i]) * t;
+    }
+  }
+
+  static void interleave2(float *dst, const float *left, const float *right,
+                          std::size_t nb_frames) {
+    std::size_t i = 0;
+    for (; i + W <= nb_frames; i += W) {
+      V::interleave2(dst + 2 * i, left + i, right + i);
+    }
+    for (; i < nb_frames; ++i) {
+      dst[2 * i] = left[i];
+      dst[2 * i + 1] = right[i];
+    }
+  }
+
+  static void deinterleave2(float *left, float *right, const float *src,
+                            std::size_t nb_frames) {
+    std::size_t i = 0;
+    for (; i + W <= nb_frames; i += W) {
+      V::deinterleave2(left + i, right + i, src + 2 * i);
+    }
+    for (; i < nb_frames; ++i) {
+      left[i] = src[2 * i];
+      right[i] = src[2 * i + 1];
+    }
+  }
+
+  static void float_to_s16(int16_t *dst, const float *src, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + W <= n; i += W) {
+      V::to_s16(dst + i, src + i);
+    }
+    for (; i < n; ++i) {
+      dst[i] = detail::to_s16(src[i]);
+    }
+  }
+
+  static void s16_to_float(float *dst, const int16_t *src, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + W <= n; i += W) {
+      V::from_s16(dst + i, src + i);
+    }
+    for (; i < n; ++i) {
+      dst[i] = src[i] * (1.0f / 32768.0f);
+    }
+  }
+
+  static float peak(const float *src, std::size_t n) {
+    auto m = V::set1(0.0f);
+    std::size_t i = 0;
+    for (; i + W <= n; i += W) {
+      m = V::max(m, V::abs(V::load(src + i)));
+    }
+    float result = V::hmax(m);
+    for (; i < n; ++i) {
+      result = max_of(result, fabsf(src[i]));
+    }
+    return result;
+  }
+
+  static double sum_squares(const float *src, std::size_t n) {
+    double total = 0;
+    std::size_t i = 0;
+    while (i + W <= n) {
+      const std::size_t end = min_of(n, i + kFloatBlock);
+      auto acc = V::set1(0.0f);
+      for (; i + W <= end; i += W) {
+        const auto x = V::load(src + i);
+        acc = V::madd(x, x, acc);
+      }
+      total += V::hsum(acc);
+    }
+    for (; i < n; ++i) {
+      total += static_cast<double>(src[i]) * src[i];
+    }
+    return total;
+  }
+
+  static double abs_sum(const float *src, std::size_t n) {
+    double total = 0;
+    std::size_t i = 0;
+    while (i + W <= n) {
+      const std::size_t end = min_of(n, i + kFloatBlock);
+      auto acc = V::set1(0.0f);
+      for (; i + W <= end; i += W) {
+        acc = V::add(acc, V::abs(V::load(src + i)));
+      }
+      total += V::hsum(acc);
+    }
+    for (; i < n; ++i) {
+      total += fabsf(src[i]);
+    }
+    return total;
+  }
+
+  static int64_t abs_sum_s16(const int16_t *src, std::size_t n) {
+    int64_t total = 0;
+    std::size_t i = 0;
+    while (i + W <= n) {
+      const std::size_t end = min_of(n, i + kS16Block);
+      auto acc = V::zero_i();
+      for (; i + W <= end; i += W) {
+        acc = V::abs_s16_add(acc, src + i);
+      }
+      total += V::hsum_i(acc);
+    }
+    for (; i < n; ++i) {
+      total += abs(static_cast<int>(src[i]));
+    }
+    return total;
+  }
+
+  static KernelTable table(Isa isa) {
+    return KernelTable{isa,          gain,         mix,
+                       crossfade,    interleave2,  deinterleave2,
+                       float_to_s16, s16_to_float, peak,
+                       sum_squares,  abs_sum,      abs_sum_s16};
+  }
+};
+
+} // namespace
+} // namespace detail
+} // namespace kernels
+} // namespace avpro
+
+#endif
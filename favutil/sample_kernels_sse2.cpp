@@ -0,0 +1,89 @@
+#include "sample_kernels_impl.h"
+#include <emmintrin.h>
+
+namespace avpro {
+namespace kernels {
+namespace {
+
+struct Sse2 {
+  using F = __m128;
+  using I = __m128i;
+  static constexpr std::size_t kWidth = 4;
+
+  static F load(const float *p) { return _mm_loadu_ps(p); }
+  static void store(float *p, F v) { _mm_storeu_ps(p, v); }
+  static F set1(float x) { return _mm_set1_ps(x); }
+  static F add(F a, F b) { return _mm_add_ps(a, b); }
+  static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+  static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+  static F madd(F a, F b, F c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+  static F max(F a, F b) { return _mm_max_ps(a, b); }
+  static F abs(F v) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), v); }
+
+  static float hmax(F v) {
+    v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+  }
+
+  static float hsum(F v) {
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+  }
+
+  static void interleave2(float *dst, const float *left, const float *right) {
+    const F l = load(left);
+    const F r = load(right);
+    store(dst, _mm_unpacklo_ps(l, r));
+    store(dst + 4, _mm_unpackhi_ps(l, r));
+  }
+
+  static void deinterleave2(float *left, float *right, const float *src) {
+    const F a = load(src);
+    const F b = load(src + 4);
+    store(left, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    store(right, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+  }
+
+  static void to_s16(int16_t *dst, const float *src) {
+    F x = _mm_mul_ps(load(src), _mm_set1_ps(32768.0f));
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-32768.0f)),
+                   _mm_set1_ps(32767.0f));
+    const I i = _mm_cvtps_epi32(x);
+    _mm_storel_epi64(reinterpret_cast<I *>(dst), _mm_packs_epi32(i, i));
+  }
+
+  static void from_s16(float *dst, const int16_t *src) {
+    const I s = _mm_loadl_epi64(reinterpret_cast<const I *>(src));
+    /* Sign extension: the int16 lands in the high half, shift it down. */
+    const I i = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+    store(dst, _mm_mul_ps(_mm_cvtepi32_ps(i), _mm_set1_ps(1.0f / 32768.0f)));
+  }
+
+  static I zero_i() { return _mm_setzero_si128(); }
+
+  static I abs_s16_add(I acc, const int16_t *src) {
+    const I s = _mm_loadl_epi64(reinterpret_cast<const I *>(src));
+    const I sign = _mm_srai_epi16(s, 15);
+    /* |-32768| wraps to 0x8000, which is right once read as unsigned. */
+    const I a = _mm_sub_epi16(_mm_xor_si128(s, sign), sign);
+    return _mm_add_epi32(acc, _mm_unpacklo_epi16(a, _mm_setzero_si128()));
+  }
+
+  static int64_t hsum_i(I v) {
+    alignas(16) int32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<I *>(lanes), v);
+    return int64_t(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+  }
+};
+
+} // namespace
+
+const KernelTable *sse2_kernels() {
+  static const KernelTable table = detail::Kernels<Sse2>::table(Isa::kSse2);
+  return &table;
+}
+
+} // namespace kernels
+} // namespace avpro
@@ -0,0 +1,178 @@
+#include "stream_info.h"
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+namespace avpro {
+
+/// Probing bounds of fast mode: enough for the codec parameters of common
+/// audio streams, which the demuxers mostly know from the header already.
+static constexpr int64_t kFastProbeSize = 32 << 10;
+static constexpr int64_t kFastAnalyzeDuration = AV_TIME_BASE / 10;
+/// Paths remembered at most, the cache starts over when it is full.
+static constexpr std::size_t kMaxCachedFiles = 1024;
+
+namespace {
+struct CachedStream {
+  std::shared_ptr<const AVCodecParameters> codecpar;
+  int64_t start_time;
+  int64_t duration;
+};
+
+struct CacheEntry {
+  std::uintmax_t size;
+  std::filesystem::file_time_type mtime;
+  int64_t start_time;
+  int64_t duration;
+  int64_t bit_rate;
+  std::vector<CachedStream> streams;
+};
+
+std::mutex cache_mutex;
+std::map<std::string, std::shared_ptr<const CacheEntry>> cache;
+
+std::shared_ptr<const AVCodecParameters>
+copy_codecpar(const AVCodecParameters *src) {
+  AVCodecParameters *par = avcodec_parameters_alloc();
+  if (!par) {
+    return nullptr;
+  }
+  if (avcodec_parameters_copy(par, src) < 0) {
+    avcodec_parameters_free(&par);
+    return nullptr;
+  }
+  return std::shared_ptr<const AVCodecParameters>(
+      par, [](const AVCodecParameters *p) {
+        auto par = const_cast<AVCodecParameters *>(p);
+        avcodec_parameters_free(&par);
+      });
+}
+
+/// Whether entry was probed from the file ctx has just opened.
+bool matches(const CacheEntry &entry, const AVFormatContext *ctx) {
+  if (entry.streams.size() != ctx->nb_streams) {
+    return false;
+  }
+  for (unsigned int i = 0; i < ctx->nb_streams; ++i) {
+    const AVCodecParameters *par = ctx->streams[i]->codecpar;
+    if (par->codec_type != entry.streams[i].codecpar->codec_type ||
+        par->codec_id != entry.streams[i].codecpar->codec_id) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int apply(const CacheEntry &entry, AVFormatContext *ctx) {
+  int error;
+
+  for (unsigned int i = 0; i < ctx->nb_streams; ++i) {
+    AVStream *stream = ctx->streams[i];
+    if ((error = avcodec_parameters_copy(
+             stream->codecpar, entry.streams[i].codecpar.get())) < 0) {
+      return error;
+    }
+    stream->start_time = entry.streams[i].start_time;
+    stream->duration = entry.streams[i].duration;
+  }
+  ctx->start_time = entry.start_time;
+  ctx->duration = entry.duration;
+  ctx->bit_rate = entry.bit_rate;
+  return 0;
+}
+
+std::shared_ptr<const CacheEntry>
+make_entry(const AVFormatContext *ctx, std::uintmax_t size,
+           std::filesystem::file_time_type mtime) {
+  auto entry = std::make_shared<CacheEntry>();
+  entry->size = size;
+  entry->mtime = mtime;
+  entry->start_time = ctx->start_time;
+  entry->duration = ctx->duration;
+  entry->bit_rate = ctx->bit_rate;
+  for (unsigned int i = 0; i < ctx->nb_streams; ++i) {
+    const AVStream *stream = ctx->streams[i];
+    auto codecpar = copy_codecpar(stream->codecpar);
+    if (!codecpar) {
+      return nullptr;
+    }
+    entry->streams.push_back(CachedStream{.codecpar = std::move(codecpar),
+                                          .start_time = stream->start_time,
+                                          .duration = stream->duration});
+  }
+  return entry;
+}
+} // namespace
+
+int find_stream_info(AVFormatContext *input_format_context, const char *path,
+                     bool fast) {
+  std::error_code ec;
+  std::uintmax_t size = 0;
+  std::filesystem::file_time_type mtime;
+  bool cacheable = false;
+  int error;
+
+  if (path && *path) {
+    size = std::filesystem::file_size(path, ec);
+    if (!ec) {
+      mtime = std::filesystem::last_write_time(path, ec);
+    }
+    cacheable = !ec;
+  }
+
+  if (cacheable && fast) {
+    std::shared_ptr<const CacheEntry> entry;
+    {
+      std::lock_guard<std::mutex> lock(cache_mutex);
+      auto it = cache.find(path);
+      if (it != cache.end() && it->second->size == size &&
+          it->second->mtime == mtime) {
+        entry = it->second;
+      }
+    }
+    if (entry && matches(*entry, input_format_context)) {
+      return apply(*entry, input_format_context);
+    }
+  }
+
+  if (fast) {
+    input_format_context->probesize = kFastProbeSize;
+    input_format_context->max_analyze_duration = kFastAnalyzeDuration;
+  }
+  if ((error = avformat_find_stream_info(input_format_context, NULL)) < 0) {
+    return error;
+  }
+
+  if (cacheable) {
+    auto entry = make_entry(input_format_context, size, mtime);
+    if (entry) {
+      std::lock_guard<std::mutex> lock(cache_mutex);
+      if (cache.size() >= kMaxCachedFiles) {
+        cache.clear();
+      }
+      cache[path] = std::move(entry);
+    }
+  }
+  return error;
+}
+
+void discard_other_streams(AVFormatContext *input_format_context,
+                           int stream_index) {
+  for (unsigned int i = 0; i < input_format_context->nb_streams; ++i) {
+    if (static_cast<int>(i) != stream_index)
+      input_format_context->streams[i]->discard = AVDISCARD_ALL;
+  }
+}
+
+int64_t input_bytes_read(const AVFormatContext *input_format_context) {
+  return input_format_context->pb ? input_format_context->pb->bytes_read : 0;
+}
+
+} // namespace avpro
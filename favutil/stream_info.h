@@ -0,0 +1,40 @@
+#ifndef AVPRO_STREAM_INFO_H
+#define AVPRO_STREAM_INFO_H
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+namespace avpro {
+
+/// Bytes a demuxer read from its input against the payload of the packets it
+/// handed to the decoder, the rest went to other streams and the container.
+struct DemuxStats {
+  int64_t bytes_read{0};
+  int64_t bytes_used{0};
+};
+
+/// avformat_find_stream_info with a fast path for time-to-first-sample.
+///
+/// Every probe of a file path is remembered for the process, keyed by path,
+/// size and modification time. With fast set, a remembered result is applied
+/// to the streams without reading anything; otherwise probing is limited to
+/// a few packets instead of the default 5 MB / 5 s. path may be NULL for
+/// inputs without one (custom I/O), nothing is cached then.
+///
+/// Returns >= 0 on success or a negative AVERROR, like the FFmpeg call.
+int find_stream_info(AVFormatContext *input_format_context, const char *path,
+                     bool fast);
+
+/// Let the demuxer drop every stream except stream_index. Demuxers with a
+/// sample index (mov/mp4) then skip the payload of the other streams on the
+/// input, the others at least return no packets for them.
+void discard_other_streams(AVFormatContext *input_format_context,
+                           int stream_index);
+
+/// Bytes read from the input so far, probing and seeking included.
+int64_t input_bytes_read(const AVFormatContext *input_format_context);
+
+} // namespace avpro
+
+#endif
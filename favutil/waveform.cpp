@@ -1,5 +1,6 @@
 #include "waveform.h"
 #include "common.h"
+#include "sample_kernels.h"
 #include <assert.h>
 #include <list>
 #include <algorithm>
@@ -43,7 +44,7 @@ int avpro::Waveform::execute(std::string_view url, int waveform_per_second,
     const int samples_per_waveform = sample_rate / waveform_per_second;
     assert(samples_per_waveform > 0);
     int next_samples = samples_per_waveform;
-    int values = 0;
+    int64_t values = 0;
     std::list<int> data;
     int max_value = 0;
     ret = media.decode_audio(
@@ -54,10 +55,13 @@ int avpro::Waveform::execute(std::string_view url, int waveform_per_second,
             const int16_t *p_end = p + n;
 
             while (p < p_end) {
-              values += static_cast<int>(std::abs(*p));
-              --next_samples;
+              const int n = static_cast<int>(
+                  std::min<std::ptrdiff_t>(next_samples, p_end - p));
+              values += kernels::abs_sum_s16(p, n);
+              next_samples -= n;
+              p += n;
               if (next_samples == 0) {
-                int value = values / samples_per_waveform;
+                int value = static_cast<int>(values / samples_per_waveform);
                 if (value > max_value) {
                   max_value = value;
                 }
@@ -65,7 +69,6 @@ int avpro::Waveform::execute(std::string_view url, int waveform_per_second,
                 values = 0;
                 next_samples = samples_per_waveform;
               }
-              p++;
             }
           });
         });
@@ -0,0 +1,122 @@
+#include "ffmpeg_audio_async_encoder.h"
+#include <algorithm>
+
+namespace spleeter {
+namespace codec {
+
+FFmpegAsyncAudioEncoder::FFmpegAsyncAudioEncoder(
+    std::unique_ptr<FFmpegAudioEncoder> encoder, std::size_t depth)
+    : encoder_(std::move(encoder)), pending_(depth) {}
+
+void FFmpegAsyncAudioEncoder::run() {
+  std::unique_ptr<Waveform> waveform;
+
+  while (pending_.pop(waveform)) {
+    const int ret = encoder_->encode(waveform->view());
+    if (ret <= 0) {
+      /* Producers waiting on a full queue give up and see the result. */
+      result_ = ret;
+      pending_.close();
+      break;
+    }
+    last_timestamp_ = encoder_->last_timestamp();
+    recycle(std::move(waveform));
+  }
+}
+
+void FFmpegAsyncAudioEncoder::recycle(std::unique_ptr<Waveform> waveform) {
+  /* Keep no more spare buffers than can be in flight. */
+  if (free_.size() <= pending_.size() + 1) {
+    free_.push(std::move(waveform));
+  }
+}
+
+std::unique_ptr<FFmpegAsyncAudioEncoder> FFmpegAsyncAudioEncoder::create(
+    std::string path, int src_sample_rate, AVSampleFormat src_sample_fmt,
+    const AVChannelLayout &src_ch_layout, int bitrate, std::size_t depth,
+    CancelToken *cancel_token, std::shared_ptr<avpro::MediaPool> pool,
+    const avpro::OutputSink *sink) {
+  if (!depth) {
+    fprintf(stderr, "Invalid encoder queue depth\n");
+    return nullptr;
+  }
+
+  auto encoder = FFmpegAudioEncoder::create(
+      std::move(path), src_sample_rate, src_sample_fmt, src_ch_layout,
+      bitrate, cancel_token, std::move(pool), sink);
+  if (!encoder) {
+    return nullptr;
+  }
+
+  auto async =
+      std::make_unique<FFmpegAsyncAudioEncoder>(std::move(encoder), depth);
+  async->thread_ = std::thread(&FFmpegAsyncAudioEncoder::run, async.get());
+  return async;
+}
+
+int FFmpegAsyncAudioEncoder::queue(std::unique_ptr<Waveform> waveform) {
+  int ret = result_.load();
+  if (ret <= 0) {
+    return ret;
+  }
+  if (!pending_.push(std::move(waveform))) {
+    /* Closed by a failure, or finish was already called. */
+    ret = result_.load();
+    return ret <= 0 ? ret : AVERROR_EXIT;
+  }
+  return 1;
+}
+
+int FFmpegAsyncAudioEncoder::encode(Waveform &&waveform) {
+  if (!waveform.nb_frames) {
+    return result_.load();
+  }
+  return queue(std::make_unique<Waveform>(std::move(waveform)));
+}
+
+int FFmpegAsyncAudioEncoder::encode(const WaveformView &waveform) {
+  std::unique_ptr<Waveform> copy;
+
+  if (!waveform.nb_frames) {
+    return result_.load();
+  }
+  if (!free_.try_pop(copy)) {
+    copy = std::make_unique<Waveform>();
+  }
+  copy->nb_frames = waveform.nb_frames;
+  copy->nb_channels = waveform.nb_channels;
+  copy->data.resize(waveform.nb_frames * waveform.nb_channels);
+  if (waveform.contiguous()) {
+    std::copy(waveform.data,
+              waveform.data + waveform.nb_frames * waveform.nb_channels,
+              copy->data.begin());
+  } else {
+    for (std::size_t i = 0; i < waveform.nb_frames; ++i) {
+      std::copy(waveform.frame(i), waveform.frame(i) + waveform.nb_channels,
+                copy->data.begin() + i * waveform.nb_channels);
+    }
+  }
+  return queue(std::move(copy));
+}
+
+int FFmpegAsyncAudioEncoder::finish() {
+  pending_.close();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  const int ret = result_.load();
+  if (ret <= 0) {
+    return ret;
+  }
+  return encoder_->finish();
+}
+
+FFmpegAsyncAudioEncoder::~FFmpegAsyncAudioEncoder() {
+  pending_.close();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+} // namespace codec
+} // namespace spleeter
@@ -0,0 +1,73 @@
+#ifndef SPLEETER_FFMPEG_AUDIO_ASYNC_ENCODER_H
+#define SPLEETER_FFMPEG_AUDIO_ASYNC_ENCODER_H
+
+#include "blocking_queue.h"
+#include "common.h"
+#include "ffmpeg_audio_encoder.h"
+#include "waveform.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace spleeter {
+namespace codec {
+
+/// Runs an FFmpegAudioEncoder on a background thread. encode only queues the
+/// samples and returns, the thread converts, encodes and muxes them in order.
+/// At most depth waveforms wait, a producer that runs ahead blocks.
+class FFmpegAsyncAudioEncoder {
+  std::unique_ptr<FFmpegAudioEncoder> encoder_;
+
+  BlockingQueue<std::unique_ptr<Waveform>> pending_;
+  /// encoded waveforms handed back for the next view copy
+  BlockingQueue<std::unique_ptr<Waveform>> free_;
+  /// first failure or cancellation of the encode thread, 1 while fine
+  std::atomic<int> result_{1};
+  std::atomic<std::int64_t> last_timestamp_{0};
+  std::thread thread_;
+
+  void run();
+
+  void recycle(std::unique_ptr<Waveform> waveform);
+
+  int queue(std::unique_ptr<Waveform> waveform);
+
+public:
+  FFmpegAsyncAudioEncoder(std::unique_ptr<FFmpegAudioEncoder> encoder,
+                          std::size_t depth);
+
+  FFmpegAsyncAudioEncoder(const FFmpegAsyncAudioEncoder &) = delete;
+
+  FFmpegAsyncAudioEncoder &
+  operator=(const FFmpegAsyncAudioEncoder &) = delete;
+
+  static std::unique_ptr<FFmpegAsyncAudioEncoder>
+  create(std::string path, int src_sample_rate, AVSampleFormat src_sample_fmt,
+         const AVChannelLayout &src_ch_layout, int bitrate, std::size_t depth,
+         CancelToken *cancel_token,
+         std::shared_ptr<avpro::MediaPool> pool = nullptr,
+         const avpro::OutputSink *sink = nullptr);
+
+  /// Queues the waveform without copying it. Returns 1 once queued, or the
+  /// result of an earlier failed or canceled encode.
+  int encode(Waveform &&waveform);
+
+  /// Queues a copy of the viewed samples, same results as above.
+  int encode(const WaveformView &waveform);
+
+  /// Waits for the queued waveforms, then flushes the encoder and writes the
+  /// trailer. Same results as FFmpegAudioEncoder::finish.
+  int finish();
+
+  /// Timestamp (milliseconds) of the end of the last encoded waveform.
+  std::int64_t last_timestamp() const { return last_timestamp_.load(); }
+
+  /// Waveforms queued and not yet encoded.
+  std::size_t pending() const { return pending_.size(); }
+
+  ~FFmpegAsyncAudioEncoder();
+};
+} // namespace codec
+} // namespace spleeter
+
+#endif
@@ -1,6 +1,11 @@
 #include "ffmpeg_audio_codec.h"
+#include "ffmpeg_audio_async_encoder.h"
 #include "ffmpeg_audio_decoder.h"
 #include "ffmpeg_audio_encoder.h"
+#include "ffmpeg_audio_multi_encoder.h"
+#include "ffmpeg_audio_parallel_encoder.h"
+#include "ffmpeg_audio_prefetch_decoder.h"
+#include "ffmpeg_audio_sliced_decoder.h"
 #include "waveform.h"
 #include <algorithm>
 #include <assert.h>
@@ -10,18 +15,67 @@
 
 namespace spleeter {
 
-static constexpr AVSampleFormat kSampleFormat = AV_SAMPLE_FMT_FLT;
+/// The codecs exchange samples in the memory layout of Waveform.
+static constexpr AVSampleFormat kSampleFormat =
+    codec::av_sample_format<Waveform::sample_type, Waveform::layout_type>();
 static constexpr AVChannelLayout kChannelLayout = AV_CHANNEL_LAYOUT_STEREO;
+/// Input per chunk in chunked encoding, long enough that the pre-roll is
+/// negligible.
+static constexpr std::size_t kEncodeChunkSeconds = 20;
 
-AudioDecoder::AudioDecoder(std::string path, CancelToken *cancel_token)
+AudioDecoder::AudioDecoder(std::string path, CancelToken *cancel_token,
+                           std::shared_ptr<avpro::MediaPool> pool,
+                           bool fast_open)
     : decoder_(codec::FFmpegAudioDecoder::create(
           path, spleeter::constants::kSampleRate, kSampleFormat, kChannelLayout,
-          cancel_token)) {}
+          cancel_token, std::move(pool), nullptr, fast_open)) {}
+
+AudioDecoder::AudioDecoder(avpro::InputSource source,
+                           CancelToken *cancel_token,
+                           std::shared_ptr<avpro::MediaPool> pool,
+                           bool fast_open)
+    : decoder_(codec::FFmpegAudioDecoder::create(
+          "", spleeter::constants::kSampleRate, kSampleFormat, kChannelLayout,
+          cancel_token, std::move(pool), &source, fast_open)) {}
 
 int AudioDecoder::Decode(std::unique_ptr<Waveform> &result,
-                         std::size_t max_frame_size) {
+                         std::size_t max_frame_size,
+                         std::pmr::memory_resource *memory) {
+  assert(decoder_);
+
+  return decoder_->decode(result, max_frame_size, memory);
+}
+
+int AudioDecoder::DecodeInto(Waveform &waveform, std::size_t max_frame_size) {
+  assert(decoder_);
+
+  return decoder_->decode_into(waveform, max_frame_size);
+}
+
+int AudioDecoder::DecodeAppend(Waveform &waveform,
+                               std::size_t max_frame_size) {
+  assert(decoder_);
+
+  return decoder_->decode_append(waveform, max_frame_size);
+}
 
-  return decoder_->decode(result, max_frame_size);
+int AudioDecoder::Seek(std::int64_t timestamp) {
+  assert(decoder_);
+
+  return decoder_->seek(timestamp);
+}
+
+int AudioDecoder::DecodeRange(std::int64_t start, std::size_t nb_frames,
+                              Waveform &waveform) {
+  assert(decoder_);
+
+  return decoder_->decode_range(start, nb_frames, waveform);
+}
+
+avpro::DemuxStats AudioDecoder::Stats() const {
+  assert(decoder_);
+
+  return decoder_->demux_stats();
 }
 
 AudioDecoder &AudioDecoder::operator=(AudioDecoder &&) = default;
@@ -30,27 +84,190 @@ AudioDecoder::AudioDecoder(AudioDecoder &&) = default;
 
 AudioDecoder::~AudioDecoder() = default;
 
+SlicedAudioDecoder::SlicedAudioDecoder(std::string path,
+                                       CancelToken *cancel_token,
+                                       int nb_slices, std::size_t chunk_frames,
+                                       std::size_t max_buffered_chunks,
+                                       std::shared_ptr<avpro::MediaPool> pool,
+                                       bool fast_open)
+    : decoder_(codec::FFmpegSlicedAudioDecoder::create(
+          path, spleeter::constants::kSampleRate, kSampleFormat, kChannelLayout,
+          nb_slices, chunk_frames, max_buffered_chunks, cancel_token,
+          std::move(pool), nullptr, fast_open)) {}
+
+SlicedAudioDecoder::SlicedAudioDecoder(avpro::InputSource source,
+                                       CancelToken *cancel_token,
+                                       int nb_slices, std::size_t chunk_frames,
+                                       std::size_t max_buffered_chunks,
+                                       std::shared_ptr<avpro::MediaPool> pool,
+                                       bool fast_open)
+    : decoder_(codec::FFmpegSlicedAudioDecoder::create(
+          "", spleeter::constants::kSampleRate, kSampleFormat, kChannelLayout,
+          source.size >= 0 ? nb_slices : 1, chunk_frames, max_buffered_chunks,
+          cancel_token, std::move(pool), &source, fast_open)) {}
+
+int SlicedAudioDecoder::Decode(std::unique_ptr<Waveform> &result,
+                               std::size_t max_frame_size,
+                               std::pmr::memory_resource *memory) {
+  assert(decoder_);
+
+  return decoder_->decode(result, max_frame_size, memory);
+}
+
+int SlicedAudioDecoder::DecodeInto(Waveform &waveform,
+                                   std::size_t max_frame_size) {
+  assert(decoder_);
+
+  return decoder_->decode_into(waveform, max_frame_size);
+}
+
+avpro::DemuxStats SlicedAudioDecoder::Stats() const {
+  assert(decoder_);
+
+  return decoder_->demux_stats();
+}
+
+SlicedAudioDecoder &
+SlicedAudioDecoder::operator=(SlicedAudioDecoder &&) = default;
+
+SlicedAudioDecoder::SlicedAudioDecoder(SlicedAudioDecoder &&) = default;
+
+SlicedAudioDecoder::~SlicedAudioDecoder() = default;
+
+PrefetchAudioDecoder::PrefetchAudioDecoder(
+    std::string path, CancelToken *cancel_token, std::size_t chunk_frames,
+    std::size_t depth, std::shared_ptr<avpro::MediaPool> pool, bool fast_open)
+    : decoder_(codec::FFmpegPrefetchAudioDecoder::create(
+          path, spleeter::constants::kSampleRate, kSampleFormat, kChannelLayout,
+          chunk_frames, depth, cancel_token, std::move(pool), nullptr,
+          fast_open)) {}
+
+PrefetchAudioDecoder::PrefetchAudioDecoder(
+    avpro::InputSource source, CancelToken *cancel_token,
+    std::size_t chunk_frames, std::size_t depth,
+    std::shared_ptr<avpro::MediaPool> pool, bool fast_open)
+    : decoder_(codec::FFmpegPrefetchAudioDecoder::create(
+          "", spleeter::constants::kSampleRate, kSampleFormat, kChannelLayout,
+          chunk_frames, depth, cancel_token, std::move(pool), &source,
+          fast_open)) {}
+
+int PrefetchAudioDecoder::Decode(std::unique_ptr<Waveform> &result,
+                                 std::size_t max_frame_size,
+                                 std::pmr::memory_resource *memory) {
+  assert(decoder_);
+
+  return decoder_->decode(result, max_frame_size, memory);
+}
+
+int PrefetchAudioDecoder::DecodeInto(Waveform &waveform,
+                                     std::size_t max_frame_size) {
+  assert(decoder_);
+
+  return decoder_->decode_into(waveform, max_frame_size);
+}
+
+avpro::DemuxStats PrefetchAudioDecoder::Stats() const {
+  assert(decoder_);
+
+  return decoder_->demux_stats();
+}
+
+PrefetchAudioDecoder &
+PrefetchAudioDecoder::operator=(PrefetchAudioDecoder &&) = default;
+
+PrefetchAudioDecoder::PrefetchAudioDecoder(PrefetchAudioDecoder &&) = default;
+
+PrefetchAudioDecoder::~PrefetchAudioDecoder() = default;
+
 AudioEncoder::AudioEncoder(std::string out_filename,
-                           CancelToken *cancel_token)
-    : encoder_(codec::FFmpegAudioEncoder::create(
-          out_filename, spleeter::constants::kSampleRate, kSampleFormat,
-          kChannelLayout, -1, cancel_token)) {}
+                           CancelToken *cancel_token,
+                           std::shared_ptr<avpro::MediaPool> pool,
+                           std::size_t async_depth, int nb_threads) {
+  Open(out_filename, nullptr, cancel_token, std::move(pool), async_depth,
+       nb_threads);
+}
+
+AudioEncoder::AudioEncoder(avpro::OutputSink sink, CancelToken *cancel_token,
+                           std::shared_ptr<avpro::MediaPool> pool,
+                           std::size_t async_depth, int nb_threads) {
+  Open("", &sink, cancel_token, std::move(pool), async_depth, nb_threads);
+}
+
+void AudioEncoder::Open(const std::string &out_filename,
+                        const avpro::OutputSink *sink,
+                        CancelToken *cancel_token,
+                        std::shared_ptr<avpro::MediaPool> pool,
+                        std::size_t async_depth, int nb_threads) {
+  if (nb_threads > 1 && codec::FFmpegParallelAudioEncoder::supports(
+                            out_filename, sink ? sink->format : "")) {
+    parallel_encoder_ = codec::FFmpegParallelAudioEncoder::create(
+        out_filename, spleeter::constants::kSampleRate, kSampleFormat,
+        kChannelLayout, -1, nb_threads,
+        kEncodeChunkSeconds * spleeter::constants::kSampleRate, cancel_token,
+        std::move(pool), sink);
+  } else if (async_depth) {
+    async_encoder_ = codec::FFmpegAsyncAudioEncoder::create(
+        out_filename, spleeter::constants::kSampleRate, kSampleFormat,
+        kChannelLayout, -1, async_depth, cancel_token, std::move(pool), sink);
+  } else {
+    encoder_ = codec::FFmpegAudioEncoder::create(
+        out_filename, spleeter::constants::kSampleRate, kSampleFormat,
+        kChannelLayout, -1, cancel_token, std::move(pool), sink);
+  }
+}
 
 int AudioEncoder::FinishEncode() {
-  assert(encoder_);
+  assert(*this);
 
+  if (parallel_encoder_) {
+    return parallel_encoder_->finish();
+  }
+  if (async_encoder_) {
+    return async_encoder_->finish();
+  }
   return encoder_->finish();
 }
 
-int AudioEncoder::Encode(const Waveform &waveform) {
-  assert(encoder_);
+int AudioEncoder::Encode(const WaveformView &waveform) {
+  assert(*this);
 
+  if (parallel_encoder_) {
+    return parallel_encoder_->encode(waveform);
+  }
+  if (async_encoder_) {
+    return async_encoder_->encode(waveform);
+  }
   int ret = encoder_->encode(waveform);
 
   return ret;
 }
 
+int AudioEncoder::Encode(Waveform &&waveform) {
+  assert(*this);
+
+  if (parallel_encoder_) {
+    return parallel_encoder_->encode(std::move(waveform));
+  }
+  if (async_encoder_) {
+    return async_encoder_->encode(std::move(waveform));
+  }
+  return encoder_->encode(waveform);
+}
+
+int AudioEncoder::Encode(const WaveformRope &waveform) {
+  assert(*this);
+
+  return waveform.for_each_chunk(
+      [this](const WaveformView &chunk) { return Encode(chunk); });
+}
+
 std::int64_t AudioEncoder::LastTimestamp() {
+  if (parallel_encoder_) {
+    return parallel_encoder_->last_timestamp();
+  }
+  if (async_encoder_) {
+    return async_encoder_->last_timestamp();
+  }
   return encoder_->last_timestamp();
 }
 
@@ -60,4 +277,42 @@ AudioEncoder::AudioEncoder(AudioEncoder &&) = default;
 
 AudioEncoder::~AudioEncoder() = default;
 
+MultiAudioEncoder::MultiAudioEncoder(const std::vector<AudioOutput> &outputs,
+                                     CancelToken *cancel_token,
+                                     std::shared_ptr<avpro::MediaPool> pool,
+                                     std::size_t queue_depth)
+    : encoder_(codec::FFmpegMultiAudioEncoder::create(
+          outputs, spleeter::constants::kSampleRate, kSampleFormat,
+          kChannelLayout, queue_depth, cancel_token, std::move(pool))) {}
+
+int MultiAudioEncoder::Encode(const WaveformView &waveform) {
+  assert(encoder_);
+
+  return encoder_->encode(waveform);
+}
+
+int MultiAudioEncoder::Encode(const WaveformRope &waveform) {
+  assert(encoder_);
+
+  return waveform.for_each_chunk(
+      [this](const WaveformView &chunk) { return encoder_->encode(chunk); });
+}
+
+int MultiAudioEncoder::FinishEncode() {
+  assert(encoder_);
+
+  return encoder_->finish();
+}
+
+std::vector<AudioOutputStats> MultiAudioEncoder::Stats() const {
+  return encoder_ ? encoder_->stats() : std::vector<AudioOutputStats>{};
+}
+
+MultiAudioEncoder &
+MultiAudioEncoder::operator=(MultiAudioEncoder &&) = default;
+
+MultiAudioEncoder::MultiAudioEncoder(MultiAudioEncoder &&) = default;
+
+MultiAudioEncoder::~MultiAudioEncoder() = default;
+
 } // namespace spleeter
\ No newline at end of file
@@ -7,17 +7,33 @@
 #define SPLEETER_FFMPEG_AUDIO_CODEC_H
 
 #include "common.h"
+#include "favutil/io.h"
+#include "favutil/pool.h"
+#include "favutil/stream_info.h"
 #include "waveform.h"
+#include "waveform_rope.h"
 #include <atomic>
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace spleeter {
 namespace codec {
 class FFmpegAudioEncoder;
 
+class FFmpegAsyncAudioEncoder;
+
+class FFmpegMultiAudioEncoder;
+
+class FFmpegParallelAudioEncoder;
+
 class FFmpegAudioDecoder;
+
+class FFmpegSlicedAudioDecoder;
+
+class FFmpegPrefetchAudioDecoder;
 } // namespace codec
 
 class AudioDecoder {
@@ -33,18 +49,142 @@ public:
 
   AudioDecoder &operator=(AudioDecoder &&);
 
-  AudioDecoder(std::string path, CancelToken *cancel_token);
+  /// pool is shared by the codecs of one job, a private one is used if null.
+  /// fast_open probes the streams briefly, or not at all on a repeat open of
+  /// an unchanged file, for interactive callers.
+  AudioDecoder(std::string path, CancelToken *cancel_token,
+               std::shared_ptr<avpro::MediaPool> pool = nullptr,
+               bool fast_open = false);
+
+  /// Decodes bytes from memory, a mapped file or a descriptor instead of a
+  /// path. Seeking needs a source of known size.
+  AudioDecoder(avpro::InputSource source, CancelToken *cancel_token,
+               std::shared_ptr<avpro::MediaPool> pool = nullptr,
+               bool fast_open = false);
+
+  /// The result's storage comes from memory; a SpillResource keeps the
+  /// samples of a whole long file in a mapped temporary file.
+  int Decode(std::unique_ptr<Waveform> &result, std::size_t max_frame_size,
+             std::pmr::memory_resource *memory = sample_memory());
+
+  /// Same as Decode, but fills the caller's waveform in place so its storage
+  /// can be reused across calls. waveform.nb_frames is 0 at end of input.
+  int DecodeInto(Waveform &waveform, std::size_t max_frame_size);
+
+  /// Like DecodeInto, but keeps the frames already in waveform and decodes
+  /// after them.
+  int DecodeAppend(Waveform &waveform, std::size_t max_frame_size);
 
-  int Decode(std::unique_ptr<Waveform> &result, std::size_t max_frame_size);
+  /// Seek to timestamp (milliseconds), sample accurate.
+  int Seek(std::int64_t timestamp);
+
+  /// Decode nb_frames frames starting at start (milliseconds).
+  int DecodeRange(std::int64_t start, std::size_t nb_frames,
+                  Waveform &waveform);
+
+  /// Input bytes read against the audio payload used, a large gap means the
+  /// container carries other streams the demuxer could not skip.
+  avpro::DemuxStats Stats() const;
 
   operator bool() { return static_cast<bool>(decoder_); }
 
   ~AudioDecoder();
 };
 
+/// Decodes long files as nb_slices time ranges on as many threads and
+/// returns the samples in order, exactly like AudioDecoder would.
+class SlicedAudioDecoder {
+private:
+  std::unique_ptr<codec::FFmpegSlicedAudioDecoder> decoder_;
+
+public:
+  SlicedAudioDecoder(const SlicedAudioDecoder &) = delete;
+
+  SlicedAudioDecoder &operator=(const SlicedAudioDecoder &) = delete;
+
+  SlicedAudioDecoder(SlicedAudioDecoder &&);
+
+  SlicedAudioDecoder &operator=(SlicedAudioDecoder &&);
+
+  /// chunk_frames is the granularity the slices decode at, at most
+  /// max_buffered_chunks of them wait per slice (0 is unbounded).
+  SlicedAudioDecoder(std::string path, CancelToken *cancel_token,
+                     int nb_slices, std::size_t chunk_frames,
+                     std::size_t max_buffered_chunks = 0,
+                     std::shared_ptr<avpro::MediaPool> pool = nullptr,
+                     bool fast_open = false);
+
+  /// Slices need a source of known size, a pipe decodes as one slice.
+  SlicedAudioDecoder(avpro::InputSource source, CancelToken *cancel_token,
+                     int nb_slices, std::size_t chunk_frames,
+                     std::size_t max_buffered_chunks = 0,
+                     std::shared_ptr<avpro::MediaPool> pool = nullptr,
+                     bool fast_open = false);
+
+  int Decode(std::unique_ptr<Waveform> &result, std::size_t max_frame_size,
+             std::pmr::memory_resource *memory = sample_memory());
+
+  int DecodeInto(Waveform &waveform, std::size_t max_frame_size);
+
+  /// Summed over the slices.
+  avpro::DemuxStats Stats() const;
+
+  operator bool() { return static_cast<bool>(decoder_); }
+
+  ~SlicedAudioDecoder();
+};
+
+/// Decodes on a background thread, up to depth chunks of chunk_frames frames
+/// ahead of the caller, so Decode returns at once while data is ready.
+class PrefetchAudioDecoder {
+private:
+  std::unique_ptr<codec::FFmpegPrefetchAudioDecoder> decoder_;
+
+public:
+  PrefetchAudioDecoder(const PrefetchAudioDecoder &) = delete;
+
+  PrefetchAudioDecoder &operator=(const PrefetchAudioDecoder &) = delete;
+
+  PrefetchAudioDecoder(PrefetchAudioDecoder &&);
+
+  PrefetchAudioDecoder &operator=(PrefetchAudioDecoder &&);
+
+  PrefetchAudioDecoder(std::string path, CancelToken *cancel_token,
+                       std::size_t chunk_frames, std::size_t depth = 2,
+                       std::shared_ptr<avpro::MediaPool> pool = nullptr,
+                       bool fast_open = false);
+
+  PrefetchAudioDecoder(avpro::InputSource source, CancelToken *cancel_token,
+                       std::size_t chunk_frames, std::size_t depth = 2,
+                       std::shared_ptr<avpro::MediaPool> pool = nullptr,
+                       bool fast_open = false);
+
+  int Decode(std::unique_ptr<Waveform> &result, std::size_t max_frame_size,
+             std::pmr::memory_resource *memory = sample_memory());
+
+  /// Reading chunk_frames at a time swaps buffers with the decode thread
+  /// instead of copying.
+  int DecodeInto(Waveform &waveform, std::size_t max_frame_size);
+
+  /// Includes the chunks decoded ahead.
+  avpro::DemuxStats Stats() const;
+
+  operator bool() { return static_cast<bool>(decoder_); }
+
+  ~PrefetchAudioDecoder();
+};
+
 class AudioEncoder {
 private:
   std::unique_ptr<codec::FFmpegAudioEncoder> encoder_;
+  /// set instead of encoder_ in asynchronous mode
+  std::unique_ptr<codec::FFmpegAsyncAudioEncoder> async_encoder_;
+  /// set instead of encoder_ in chunked mode
+  std::unique_ptr<codec::FFmpegParallelAudioEncoder> parallel_encoder_;
+
+  void Open(const std::string &out_filename, const avpro::OutputSink *sink,
+            CancelToken *cancel_token, std::shared_ptr<avpro::MediaPool> pool,
+            std::size_t async_depth, int nb_threads);
 
 public:
   AudioEncoder(const AudioEncoder &) = delete;
@@ -55,19 +195,107 @@ public:
 
   AudioEncoder &operator=(AudioEncoder &&);
 
-  AudioEncoder(std::string out_filename, CancelToken *cancel_token);
+  /// With async_depth > 0 the encoder runs on a background thread: Encode
+  /// returns once the samples are queued, blocking only while async_depth
+  /// waveforms wait, and an encode error is returned by a later call.
+  ///
+  /// With nb_threads > 1 AAC and MP3 outputs are encoded in chunks on that
+  /// many threads and stitched into one stream; Encode returns once the
+  /// samples are buffered. Other codecs ignore it.
+  AudioEncoder(std::string out_filename, CancelToken *cancel_token,
+               std::shared_ptr<avpro::MediaPool> pool = nullptr,
+               std::size_t async_depth = 0, int nb_threads = 1);
 
-  int Encode(const Waveform &waveform);
+  /// Writes to sink instead of a file, e.g. memory, a pipe or an upload.
+  /// sink.format names the container. Same modes as above.
+  AudioEncoder(avpro::OutputSink sink, CancelToken *cancel_token,
+               std::shared_ptr<avpro::MediaPool> pool = nullptr,
+               std::size_t async_depth = 0, int nb_threads = 1);
 
+  /// Accepts a Waveform as well, a sub-range is encoded without a copy. In
+  /// asynchronous and chunked mode the samples are copied.
+  int Encode(const WaveformView &waveform);
+
+  /// Same as above, asynchronous and chunked mode keep the waveform without
+  /// a copy.
+  int Encode(Waveform &&waveform);
+
+  /// Encodes the chunks of the rope in order, without joining them.
+  int Encode(const WaveformRope &waveform);
+
+  /// In asynchronous and chunked mode waits for the queued waveforms first.
   int FinishEncode();
 
   std::int64_t LastTimestamp();
 
-  operator bool() { return static_cast<bool>(encoder_); }
+  operator bool() { return encoder_ || async_encoder_ || parallel_encoder_; }
 
   ~AudioEncoder();
 };
 
+/// One rendition of a MultiAudioEncoder, the container and codec follow the
+/// file extension like for AudioEncoder.
+struct AudioOutput {
+  std::string path;
+  /// bits per second, <= 0 for the codec default
+  int bitrate{-1};
+  /// 0 keeps the rate of the input
+  int sample_rate{0};
+};
+
+struct AudioOutputStats {
+  std::string path;
+  /// frames encoded, at the output's rate
+  std::size_t nb_frames{0};
+  /// time spent encoding and muxing on the output's thread
+  double busy_seconds{0};
+  /// time the output's thread waited for samples
+  double wait_seconds{0};
+  /// conversion shared by the outputs of one rate and sample format, the
+  /// same time is reported for each of them
+  double convert_seconds{0};
+  /// 1, 0 if canceled, or a negative AVERROR
+  int result{1};
+};
+
+/// Encodes one sample stream into several files, e.g. a bitrate ladder.
+/// Every output encodes on its own thread, outputs with the same rate and
+/// sample format share the conversion of the input.
+class MultiAudioEncoder {
+private:
+  std::unique_ptr<codec::FFmpegMultiAudioEncoder> encoder_;
+
+public:
+  MultiAudioEncoder(const MultiAudioEncoder &) = delete;
+
+  MultiAudioEncoder &operator=(const MultiAudioEncoder &) = delete;
+
+  MultiAudioEncoder(MultiAudioEncoder &&);
+
+  MultiAudioEncoder &operator=(MultiAudioEncoder &&);
+
+  /// queue_depth bounds the waveforms each output may fall behind.
+  MultiAudioEncoder(const std::vector<AudioOutput> &outputs,
+                    CancelToken *cancel_token,
+                    std::shared_ptr<avpro::MediaPool> pool = nullptr,
+                    std::size_t queue_depth = 2);
+
+  /// Returns once the samples are queued for every output.
+  int Encode(const WaveformView &waveform);
+
+  int Encode(const WaveformRope &waveform);
+
+  /// Waits for every output to finish its file.
+  int FinishEncode();
+
+  /// Per output, in the order given to the constructor.
+  std::vector<AudioOutputStats> Stats() const;
+
+  operator bool() { return static_cast<bool>(encoder_); }
+
+  ~MultiAudioEncoder();
+};
+
 } // namespace spleeter
 
 #endif /// SPLEETER_AUDIO_FFMPEG_AUDIO_ADAPTER_H
@@ -1,12 +1,16 @@
 
 #include "ffmpeg_audio_decoder.h"
 #include "common.h"
+#include "favutil/stream_info.h"
 #include "ffmpeg_audio_common.h"
-#include "libavutil/audio_fifo.h"
+#include "ffmpeg_audio_index.h"
 #include "waveform.h"
 #include <algorithm>
+#include <cassert>
+#include <climits>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <memory>
 #include <vector>
 
@@ -22,11 +26,20 @@ extern "C" {
 namespace spleeter {
 namespace codec {
 
+/// Audio decoded ahead of a seek target so the decoder state has settled,
+/// e.g. the MP3 bit reservoir or the AAC overlap of the previous frame.
+static constexpr std::int64_t kSeekPrerollMs = 200;
+
+/// Carry-over between two decode_into calls is at most what one decoded frame
+/// converts to, this covers common codecs without growing the ring.
+static constexpr int kRingNbSamples = 16384;
+
 static int output_audio_frame(
     AVFrame *frame, SwrContext *swr_ctx, AVCodecContext *audio_dec_ctx,
     uint8_t **&dst_data, int dst_rate, const AVChannelLayout &dst_ch_layout,
     enum AVSampleFormat dst_sample_fmt, int &max_dst_nb_samples,
-    int &dst_linesize, std::uint64_t &nb_samples, std::vector<float> &container
+    int &dst_linesize, std::uint64_t &nb_samples,
+    SampleVector<float> &container
 
 ) {
   //        size_t unpadded_linesize = frame->nb_samples *
@@ -75,15 +88,10 @@ static int output_audio_frame(
     //            float *p = reinterpret_cast<float *>(c_data);
     //            int bytes_per_sample =
     //            av_get_bytes_per_sample(dst_sample_fmt);
-    float *d = reinterpret_cast<float *>(dst_data[0]);
-    for (int i = 0; i < ret; ++i) {
-      for (int ch = 0; ch < dst_ch_layout.nb_channels; ++ch) {
-        // fwrite(d + i, 1, bytes_per_sample, dst_file);
-        //                    fwrite(d + ch, 1, bytes_per_sample, dst_file);
-        container.push_back(*(d + ch));
-      }
-      d += dst_ch_layout.nb_channels;
-    }
+    const float *d = reinterpret_cast<const float *>(dst_data[0]);
+    container.insert(container.end(), d,
+                     d + static_cast<std::size_t>(ret) *
+                             dst_ch_layout.nb_channels);
 
     nb_samples += ret;
     //            for (int i = 0; i < ret; i++) {
@@ -109,7 +117,7 @@ static int decode_packet(AVCodecContext *dec, const AVPacket *pkt,
                          enum AVSampleFormat dst_sample_fmt,
                          int &max_dst_nb_samples, int &dst_linesize,
                          std::uint64_t &nb_samples,
-                         std::vector<float> &container) {
+                         SampleVector<float> &container) {
   int ret = 0;
 
   // submit the packet to the decoder
@@ -198,26 +206,31 @@ static int open_codec_context(int *stream_idx, AVCodecContext **dec_ctx,
 static int open_input_file(const char *filename,
                            AVFormatContext **input_format_context,
                            int *audio_stream_idx,
-                           AVCodecContext **input_codec_context) {
+                           AVCodecContext **input_codec_context,
+                           AVSampleFormat request_sample_fmt,
+                           const avpro::InputSource *source, bool fast_open) {
   AVCodecContext *avctx;
   const AVCodec *input_codec;
   const AVStream *stream;
   int error;
 
-  /* Open the input file to read from it. */
-  if ((error = avformat_open_input(input_format_context, filename, NULL,
-                                   NULL)) < 0) {
+  /* Open the input file, or the caller's source, to read from it. */
+  if ((error = avpro::open_input(input_format_context, filename, source)) <
+      0) {
     fprintf(stderr, "Could not open input file '%s' (error '%s')\n", filename,
             av_err2str(error));
     *input_format_context = NULL;
     return error;
   }
 
-  /* Get information on the input file (number of streams etc.). */
-  if ((error = avformat_find_stream_info(*input_format_context, NULL)) < 0) {
+  /* Get information on the input file (number of streams etc.), in fast-open
+   * mode from the cache or a short probe. */
+  if ((error = avpro::find_stream_info(*input_format_context,
+                                       source ? NULL : filename, fast_open)) <
+      0) {
     fprintf(stderr, "Could not open find stream info (error '%s')\n",
             av_err2str(error));
-    avformat_close_input(input_format_context);
+    avpro::close_input(input_format_context);
     return error;
   }
 
@@ -227,16 +240,20 @@ static int open_input_file(const char *filename,
                                                -1, -1, NULL, 0)) < 0) {
     fprintf(stderr, "Could not open find stream info (error '%s')\n",
             av_err2str(error));
-    avformat_close_input(input_format_context);
+    avpro::close_input(input_format_context);
     return -1;
   }
 
   stream = (*input_format_context)->streams[*audio_stream_idx];
 
+  /* Only the audio stream is demuxed, e.g. the video of an mp4 is skipped
+   * on the input instead of read and dropped. */
+  avpro::discard_other_streams(*input_format_context, *audio_stream_idx);
+
   /* Find a decoder for the audio stream. */
   if (!(input_codec = avcodec_find_decoder(stream->codecpar->codec_id))) {
     fprintf(stderr, "Could not find input codec\n");
-    avformat_close_input(input_format_context);
+    avpro::close_input(input_format_context);
     return AVERROR_EXIT;
   }
 
@@ -244,24 +261,28 @@ static int open_input_file(const char *filename,
   avctx = avcodec_alloc_context3(input_codec);
   if (!avctx) {
     fprintf(stderr, "Could not allocate a decoding context\n");
-    avformat_close_input(input_format_context);
+    avpro::close_input(input_format_context);
     return AVERROR(ENOMEM);
   }
 
   /* Initialize the stream parameters with demuxer information. */
   error = avcodec_parameters_to_context(avctx, stream->codecpar);
   if (error < 0) {
-    avformat_close_input(input_format_context);
+    avpro::close_input(input_format_context);
     avcodec_free_context(&avctx);
     return error;
   }
 
+  /* Ask for the output format directly, decoders that can produce it (e.g.
+   * mp3float) then need no conversion at all. */
+  avctx->request_sample_fmt = request_sample_fmt;
+
   /* Open the decoder for the audio stream to use it later. */
   if ((error = avcodec_open2(avctx, input_codec, NULL)) < 0) {
     fprintf(stderr, "Could not open input codec (error '%s')\n",
             av_err2str(error));
     avcodec_free_context(&avctx);
-    avformat_close_input(input_format_context);
+    avpro::close_input(input_format_context);
     return error;
   }
 
@@ -277,158 +298,55 @@ static int open_input_file(const char *filename,
 inline void check_cancel_and_throw(CancelToken &cancel_token) {
   CancelException::check_cancel_and_throw(cancel_token);
 }
-static int decode_audio_frame(AVFrame *frame,
-                              AVFormatContext *input_format_context,
-                              AVCodecContext *input_codec_context,
-                              int *audio_st_index, int *data_present,
-                              int *finished) {
-  /* Packet used for temporary storage. */
-  AVPacket *input_packet;
+
+/**
+ * Read the next packet of the audio stream and send it to the decoder.
+ * Packets of other streams are skipped. At the end of the input file the
+ * decoder is put into draining mode instead.
+ * @param[out] packet_size Payload sent to the decoder, 0 when draining
+ * @return Error code (0 if successful)
+ */
+static int send_audio_packet(AVFormatContext *input_format_context,
+                             AVCodecContext *input_codec_context,
+                             AVPacket *input_packet, int audio_stream_idx,
+                             std::int64_t &packet_size) {
   int error;
 
-  error = init_packet(&input_packet);
-  if (error < 0)
-    return error;
+  packet_size = 0;
 
-  *data_present = 0;
-  *finished = 0;
-  /* Read one audio frame from the input file into a temporary packet. */
-  if ((error = av_read_frame(input_format_context, input_packet)) < 0) {
-    /* If we are at the end of the file, flush the decoder below. */
-    if (error == AVERROR_EOF)
-      *finished = 1;
-    else {
-      fprintf(stderr, "Could not read frame (error '%s')\n", av_err2str(error));
-      goto cleanup;
-    }
+  while ((error = av_read_frame(input_format_context, input_packet)) >= 0) {
+    if (input_packet->stream_index == audio_stream_idx)
+      break;
+    av_packet_unref(input_packet);
   }
 
-  if (input_packet->stream_index != *audio_st_index) {
-    error = 0;
-    goto cleanup;
+  if (error == AVERROR_EOF) {
+    /* Enter draining mode, the decoder returns its delayed frames. */
+    error = avcodec_send_packet(input_codec_context, NULL);
+    return error == AVERROR_EOF ? 0 : error;
+  } else if (error < 0) {
+    fprintf(stderr, "Could not read frame (error '%s')\n", av_err2str(error));
+    return error;
   }
 
-  /* Send the audio frame stored in the temporary packet to the decoder.
-   * The input audio stream decoder is used to do this. */
-  if ((error = avcodec_send_packet(input_codec_context, input_packet)) < 0) {
+  /* Send the audio frame stored in the packet to the decoder. */
+  packet_size = input_packet->size;
+  error = avcodec_send_packet(input_codec_context, input_packet);
+  av_packet_unref(input_packet);
+  if (error < 0) {
     fprintf(stderr, "Could not send packet for decoding (error '%s')\n",
             av_err2str(error));
-    goto cleanup;
-  }
-
-  /* Receive one frame from the decoder. */
-  error = avcodec_receive_frame(input_codec_context, frame);
-  /* If the decoder asks for more data to be able to decode a frame,
-   * return indicating that no data is present. */
-  if (error == AVERROR(EAGAIN)) {
-    error = 0;
-    goto cleanup;
-    /* If the end of the input file is reached, stop decoding. */
-  } else if (error == AVERROR_EOF) {
-    *finished = 1;
-    error = 0;
-    goto cleanup;
-  } else if (error < 0) {
-    fprintf(stderr, "Could not decode frame (error '%s')\n", av_err2str(error));
-    goto cleanup;
-    /* Default case: Return decoded data. */
-  } else {
-    *data_present = 1;
-    goto cleanup;
-  }
-
-cleanup:
-  av_packet_free(&input_packet);
-  return error;
-}
-static int convert_samples(const uint8_t **input_data, uint8_t **converted_data,
-                           const int frame_size, SwrContext *resample_context) {
-  int ret;
-
-  /* Convert the samples using the resampler. */
-  if ((ret = swr_convert(resample_context, converted_data, frame_size,
-                         input_data, frame_size)) < 0) {
-    fprintf(stderr, "Could not convert input samples (error '%s')\n",
-            av_err2str(ret));
+    return error;
   }
-
-  return ret;
+  return 0;
 }
-static int read_decode_convert_and_store(
-    AVAudioFifo *fifo, AVFormatContext *input_format_context,
-    AVCodecContext *input_codec_context, int out_nb_channels,
-    AVSampleFormat out_sample_fmt, int out_sample_rate,
-    SwrContext *resampler_context, int *audio_st_index, int *finished) {
-  /* Temporary storage of the input samples of the frame read from the file. */
-  AVFrame *input_frame = NULL;
-  /* Temporary storage for the converted input samples. */
-  uint8_t **converted_input_samples = NULL;
-  int data_present;
-  int ret = AVERROR_EXIT;
-
-  /* Initialize temporary storage for one input frame. */
-  if (init_input_frame(&input_frame))
-    goto cleanup;
-  /* Decode one frame worth of audio samples. */
-  if (decode_audio_frame(input_frame, input_format_context, input_codec_context,
-                         audio_st_index, &data_present, finished))
-    goto cleanup;
-  /* If we are at the end of the file and there are no more samples
-   * in the decoder which are delayed, we are actually finished.
-   * This must not be treated as an error. */
-  if (*finished) {
-    ret = 0;
-    goto cleanup;
-  }
-  /* If there is decoded data, convert and store it. */
-  if (data_present) {
-    std::int64_t delay =
-        swr_get_delay(resampler_context, input_codec_context->sample_rate);
 
-    std::int64_t dst_nb_samples =
-        av_rescale_rnd(delay + input_frame->nb_samples, out_sample_rate,
-                       input_codec_context->sample_rate, AV_ROUND_UP);
-
-    /* Initialize the temporary storage for the converted input samples. */
-    if (init_converted_samples(&converted_input_samples, out_nb_channels,
-                               dst_nb_samples, out_sample_fmt))
-      goto cleanup;
-
-    int converted_nb_samples = -1;
-
-    /* Convert the samples using the resampler. */
-    if ((converted_nb_samples = swr_convert(
-             resampler_context, converted_input_samples, dst_nb_samples,
-             (const uint8_t **)input_frame->extended_data,
-             input_frame->nb_samples)) < 0) {
-      fprintf(stderr, "Could not convert input samples (error '%s')\n",
-              av_err2str(ret));
-      goto cleanup;
-    }
-
-    /* Add the converted input samples to the FIFO buffer for later processing.
-     */
-    if (add_samples_to_fifo(fifo, converted_input_samples,
-                            converted_nb_samples))
-      goto cleanup;
-    ret = 0;
-  }
-  ret = 0;
-
-cleanup:
-  if (converted_input_samples) {
-    av_freep(&converted_input_samples[0]);
-    free(converted_input_samples);
-  }
-  av_frame_free(&input_frame);
-
-  return ret;
-}
 static int decode(std::string path, int dst_rate, AVSampleFormat dst_sample_fmt,
                   const AVChannelLayout &dst_ch_layout,
                   const std::int64_t start, const std::int64_t duration,
                   CancelToken &cancel_token, std::unique_ptr<Waveform> &result,
-                  ProgressCallback progress_callback) {
+                  ProgressCallback progress_callback,
+                  std::pmr::memory_resource *memory) {
   ///
   /// Open Input Audio
   ///
@@ -448,7 +366,8 @@ static int decode(std::string path, int dst_rate, AVSampleFormat dst_sample_fmt,
   int max_dst_nb_samples = 0;
   int dst_linesize;
   const char *src_filename = path.c_str();
-  Waveform waveform;
+  Waveform waveform =
+      Waveform::with_resource(dst_ch_layout.nb_channels, memory);
   bool canceled = false;
   auto last_progress_timestamp = get_current_timestamp();
 
@@ -475,12 +394,25 @@ static int decode(std::string path, int dst_rate, AVSampleFormat dst_sample_fmt,
       goto end;
     }
 
+    /* One allocation for the whole file instead of a copy per growth step,
+     * which matters most when memory spills to a file. */
+    if (fmt_ctx->duration != AV_NOPTS_VALUE && fmt_ctx->duration > 0) {
+      waveform.data.reserve(
+          static_cast<std::size_t>(
+              av_rescale(fmt_ctx->duration, dst_rate, AV_TIME_BASE) + 1) *
+          dst_ch_layout.nb_channels);
+    }
+
     if (open_codec_context(&audio_stream_idx, &audio_dec_ctx, fmt_ctx,
                            AVMEDIA_TYPE_AUDIO) >= 0) {
       audio_stream = fmt_ctx->streams[audio_stream_idx];
     }
     check_cancel_and_throw(cancel_token);
 
+    if (audio_stream) {
+      avpro::discard_other_streams(fmt_ctx, audio_stream_idx);
+    }
+
     /* dump input information to stderr */
     av_dump_format(fmt_ctx, 0, src_filename, 0);
 
@@ -606,110 +538,224 @@ end:
 FFmpegAudioDecoder::FFmpegAudioDecoder(std::string path, int dst_sample_rate,
                                        AVSampleFormat dst_sample_fmt,
                                        const AVChannelLayout &dst_ch_layout,
-                                       CancelToken *cancel_token)
+                                       CancelToken *cancel_token,
+                                       std::shared_ptr<avpro::MediaPool> pool)
     : path_(path), dst_sample_rate_(dst_sample_rate),
-      dst_sample_fmt_(dst_sample_fmt), cancel_token_(cancel_token) {
+      dst_sample_fmt_(dst_sample_fmt), cancel_token_(cancel_token),
+      pool_(pool ? std::move(pool) : std::make_shared<avpro::MediaPool>()) {
   av_channel_layout_copy(&dst_ch_layout_, &dst_ch_layout);
 }
 
-// int FFmpegAudioDecoder::decode(std::string path, const std::int64_t start,
-//                                const std::int64_t duration,
-//                                std::unique_ptr<Waveform> &result,
-//                                ProgressCallback progress_callback) {
-
-//   return spleeter::codec::decode(
-//       path, dst_sample_rate_, dst_sample_fmt_, dst_ch_layout_, start,
-//       duration, *cancel_token_, result, std::move(progress_callback));
-// }
-
 std::unique_ptr<FFmpegAudioDecoder> FFmpegAudioDecoder::create(
     std::string path, int dst_sample_rate, AVSampleFormat dst_sample_fmt,
-    const AVChannelLayout &dst_ch_layout, CancelToken *cancel_token) {
+    const AVChannelLayout &dst_ch_layout, CancelToken *cancel_token,
+    std::shared_ptr<avpro::MediaPool> pool, const avpro::InputSource *source,
+    bool fast_open) {
   std::unique_ptr<FFmpegAudioDecoder> decoder =
-      std::make_unique<FFmpegAudioDecoder>(
-          path, dst_sample_rate, dst_sample_fmt, dst_ch_layout, cancel_token);
+      std::make_unique<FFmpegAudioDecoder>(path, dst_sample_rate,
+                                           dst_sample_fmt, dst_ch_layout,
+                                           cancel_token, std::move(pool));
   if (open_input_file(path.c_str(), &decoder->input_format_context_,
                       &decoder->audio_stream_idx_,
-                      &decoder->input_codec_context_)) {
+                      &decoder->input_codec_context_, dst_sample_fmt, source,
+                      fast_open)) {
     return nullptr;
   }
 
-  if (init_resampler(&decoder->input_codec_context_->ch_layout,
+  if (init_converter(&decoder->input_codec_context_->ch_layout,
                      decoder->input_codec_context_->sample_fmt,
                      decoder->input_codec_context_->sample_rate, &dst_ch_layout,
-                     dst_sample_fmt, dst_sample_rate,
-                     &decoder->resample_context_))
+                     dst_sample_fmt, dst_sample_rate, decoder->converter_))
     return nullptr;
-  if (init_fifo(&decoder->fifo_, dst_sample_fmt, dst_ch_layout.nb_channels, 1))
+  if (init_ring(decoder->ring_, dst_sample_fmt, dst_ch_layout.nb_channels,
+                kRingNbSamples))
     return nullptr;
+  if (!(decoder->packet_ = decoder->pool_->acquire_packet())) {
+    fprintf(stderr, "Could not allocate packet\n");
+    return nullptr;
+  }
+  if (!(decoder->frame_ = decoder->pool_->acquire_frame())) {
+    fprintf(stderr, "Could not allocate input frame\n");
+    return nullptr;
+  }
+  /* What the probe read counts as well. */
+  decoder->bytes_read_ =
+      avpro::input_bytes_read(decoder->input_format_context_);
   return decoder;
 }
 
-int FFmpegAudioDecoder::decode(std::unique_ptr<Waveform> &result,
-                               std::size_t max_frame_size) {
-  int ret = AVERROR_EXIT;
-  bool canceled = false;
-
-  /// 不能去goto，因为fifo中可能还有未读完的数据
-  // if (finished_) {
-  //   ret = 0;
-  //   goto cleanup;
-  // }
-
-  try {
-    while (!finished_ && av_audio_fifo_size(fifo_) < max_frame_size) {
-      // av_log(nullptr, AV_LOG_DEBUG, "load\n");
-      if (read_decode_convert_and_store(
-              fifo_, input_format_context_, input_codec_context_,
-              dst_ch_layout_.nb_channels, dst_sample_fmt_, dst_sample_rate_,
-              resample_context_, &audio_stream_idx_, &finished_)) {
-        if (av_audio_fifo_size(fifo_) > 0) {
-          finished_ = 1;
-        } else {
-          goto cleanup;
-        }
-      }
+avpro::DemuxStats FFmpegAudioDecoder::demux_stats() const {
+  return avpro::DemuxStats{
+      .bytes_read = bytes_read_.load(std::memory_order_relaxed),
+      .bytes_used = bytes_used_.load(std::memory_order_relaxed)};
+}
 
-      check_cancel_and_throw(*cancel_token_);
+int FFmpegAudioDecoder::convert_into(const AVFrame *frame, Waveform &waveform,
+                                     std::size_t &nb_frames,
+                                     std::size_t end_frame) {
+  const int nb_channels = dst_ch_layout_.nb_channels;
+  const int bytes_per_frame =
+      av_get_bytes_per_sample(dst_sample_fmt_) * nb_channels;
+  /* A NULL frame flushes the samples buffered inside the resampler. */
+  const uint8_t **input_data =
+      frame ? (const uint8_t **)frame->extended_data : NULL;
+  const int input_nb_samples = frame ? frame->nb_samples : 0;
+  const std::size_t remaining = end_frame - nb_frames;
+  uint8_t *output_data[1] = {reinterpret_cast<uint8_t *>(
+      waveform.data.data() + nb_frames * nb_channels)};
+  int converted_nb_samples;
+
+  /* Some decoders only settle their output format with the first frame. */
+  if (frame &&
+      !converter_.accepts(&frame->ch_layout,
+                          static_cast<AVSampleFormat>(frame->format),
+                          frame->sample_rate)) {
+    if ((converted_nb_samples = init_converter(
+             &frame->ch_layout, static_cast<AVSampleFormat>(frame->format),
+             frame->sample_rate, &dst_ch_layout_, dst_sample_fmt_,
+             dst_sample_rate_, converter_)) < 0)
+      return converted_nb_samples;
+  }
 
-      /* If we are at the end of the input file, we continue
-       * encoding the remaining audio samples to the output file. */
-      if (finished_)
-        break;
+  int dst_nb_samples = converter_.get_out_samples(input_nb_samples);
+  if (dst_nb_samples <= 0)
+    return dst_nb_samples;
 
-      // av_audio_fifo_read(AVAudioFifo *af, void **data, int nb_samples)
+  /* Fast path: convert straight into the caller's buffer. */
+  if (!skip_nb_samples_ &&
+      static_cast<std::size_t>(dst_nb_samples) <= remaining) {
+    if ((converted_nb_samples =
+             converter_.convert(output_data, dst_nb_samples, input_data,
+                                input_nb_samples)) < 0) {
+      fprintf(stderr, "Could not convert input samples (error '%s')\n",
+              av_err2str(converted_nb_samples));
+      return converted_nb_samples;
+    }
+    nb_frames += converted_nb_samples;
+    return 0;
+  }
 
-      // av_samples_get_buffer_size(int *linesize, int nb_channels, int
-      // nb_samples, enum AVSampleFormat sample_fmt, int align)
+  /* The frame does not fit or starts before the seek target, convert it
+   * into the scratch buffer, hand over what fits and keep the rest in the
+   * ring for the next call. */
+  if (dst_nb_samples > converted_samples_.nb_samples) {
+    pool_->release_samples(converted_samples_);
+    converted_samples_ =
+        pool_->acquire_samples(nb_channels, dst_nb_samples, dst_sample_fmt_);
+    if (!converted_samples_.data) {
+      fprintf(stderr, "Could not allocate converted input samples\n");
+      return AVERROR(ENOMEM);
     }
+  }
+  if ((converted_nb_samples =
+           converter_.convert(converted_samples_.data, dst_nb_samples,
+                              input_data, input_nb_samples)) < 0) {
+    fprintf(stderr, "Could not convert input samples (error '%s')\n",
+            av_err2str(converted_nb_samples));
+    return converted_nb_samples;
+  }
 
-    if (av_audio_fifo_size(fifo_) > 0) {
-      int waveform_data_size =
-          av_samples_get_buffer_size(nullptr, dst_ch_layout_.nb_channels,
-                                     max_frame_size, dst_sample_fmt_, 1) /
-          av_get_bytes_per_sample(dst_sample_fmt_);
+  /* Drop the samples before the seek target. */
+  const int nb_skipped = static_cast<int>(
+      std::min<std::size_t>(converted_nb_samples, skip_nb_samples_));
+  uint8_t *converted =
+      converted_samples_.data[0] + nb_skipped * bytes_per_frame;
+  skip_nb_samples_ -= nb_skipped;
+  converted_nb_samples -= nb_skipped;
+
+  const int nb_copied =
+      static_cast<int>(std::min<std::size_t>(converted_nb_samples, remaining));
+  memcpy(output_data[0], converted,
+         static_cast<std::size_t>(nb_copied) * bytes_per_frame);
+  nb_frames += nb_copied;
+
+  if (converted_nb_samples > nb_copied) {
+    uint8_t *rest[1] = {converted + nb_copied * bytes_per_frame};
+    return add_samples_to_ring(ring_, rest, converted_nb_samples - nb_copied);
+  }
+  return 0;
+}
 
-      std::size_t nb_samples = std::min(
-          static_cast<std::size_t>(av_audio_fifo_size(fifo_)), max_frame_size);
+int FFmpegAudioDecoder::decode_into(Waveform &waveform,
+                                    std::size_t max_frame_size) {
+  waveform.nb_frames = 0;
+  return decode_append(waveform, max_frame_size);
+}
 
-      std::vector<float> waveform_data(nb_samples * dst_ch_layout_.nb_channels);
+int FFmpegAudioDecoder::decode_append(Waveform &waveform,
+                                      std::size_t max_frame_size) {
+  int ret = AVERROR_EXIT;
+  bool canceled = false;
+  const int nb_channels = dst_ch_layout_.nb_channels;
+  assert(!waveform.nb_frames || waveform.nb_channels == nb_channels);
+  const std::size_t start_frame = waveform.nb_frames;
+  std::size_t nb_frames = start_frame;
+  const std::size_t end_frame = nb_frames + max_frame_size;
 
-      void *data[1] = {reinterpret_cast<void *>(waveform_data.data())};
+  /* Reuse the storage of the caller, it only grows on the first call. The
+   * sample allocator leaves the new frames unset, the decoder writes them. */
+  waveform.nb_channels = nb_channels;
+  waveform.data.resize(end_frame * nb_channels);
 
-      int waveform_nb_samples = av_audio_fifo_read(fifo_, data, nb_samples);
+  try {
+    check_cancel_and_throw(*cancel_token_);
 
-      // printf("read,max%ld,1 %ld,2 %d\n", max_frame_size, nb_samples,
-      //        waveform_nb_samples);
+    /* Samples left over from the previous call come first. */
+    if (ring_.size() > 0) {
+      uint8_t *data[1] = {reinterpret_cast<uint8_t *>(
+          waveform.data.data() + nb_frames * nb_channels)};
+      nb_frames += ring_.read(data, static_cast<int>(std::min<std::size_t>(
+                                        INT_MAX, max_frame_size)));
+    }
 
-      if (waveform_nb_samples > 0) {
-        waveform_data.resize(waveform_nb_samples * dst_ch_layout_.nb_channels);
-        result.reset(new spleeter::Waveform{
-            .nb_frames = static_cast<std ::size_t>(waveform_nb_samples),
-            .nb_channels = dst_ch_layout_.nb_channels,
-            .data = std::move(waveform_data),
-        });
+    while (!finished_ && nb_frames < end_frame) {
+      /* Drain every frame the last packet produced before reading on. */
+      int error = avcodec_receive_frame(input_codec_context_, frame_);
+      if (error == AVERROR(EAGAIN)) {
+        std::int64_t packet_size;
+        if (send_audio_packet(input_format_context_, input_codec_context_,
+                              packet_, audio_stream_idx_, packet_size))
+          goto cleanup;
+        bytes_used_.fetch_add(packet_size, std::memory_order_relaxed);
+        bytes_read_.store(avpro::input_bytes_read(input_format_context_),
+                          std::memory_order_relaxed);
+        check_cancel_and_throw(*cancel_token_);
+        continue;
+      } else if (error == AVERROR_EOF) {
+        /* The decoder is drained, flush what the resampler still holds. */
+        if (convert_into(NULL, waveform, nb_frames, end_frame))
+          goto cleanup;
+        finished_ = 1;
+        break;
+      } else if (error < 0) {
+        fprintf(stderr, "Could not decode frame (error '%s')\n",
+                av_err2str(error));
+        goto cleanup;
       }
+
+      /* The first frame after a seek tells how much precedes the target. */
+      if (seek_target_frame_ >= 0) {
+        const AVStream *stream =
+            input_format_context_->streams[audio_stream_idx_];
+        const std::int64_t frame_pts = frame_->best_effort_timestamp;
+        if (frame_pts != AV_NOPTS_VALUE) {
+          const std::int64_t start_time =
+              stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+          const std::int64_t frame_position =
+              av_rescale_q(frame_pts - start_time, stream->time_base,
+                           AVRational{1, dst_sample_rate_});
+          if (frame_position < seek_target_frame_)
+            skip_nb_samples_ = seek_target_frame_ - frame_position;
+        }
+        seek_target_frame_ = -1;
+      }
+
+      error = convert_into(frame_, waveform, nb_frames, end_frame);
+      av_frame_unref(frame_);
+      if (error < 0)
+        goto cleanup;
     }
+
     check_cancel_and_throw(*cancel_token_);
 
     ret = 0;
@@ -718,6 +764,13 @@ int FFmpegAudioDecoder::decode(std::unique_ptr<Waveform> &result,
   }
 
 cleanup:
+  /* data holds exactly nb_frames frames again: a failed call leaves the
+   * waveform as it was, a cancelled one keeps what it decoded. */
+  if (ret < 0 && !canceled) {
+    nb_frames = start_frame;
+  }
+  waveform.nb_frames = nb_frames;
+  waveform.data.resize(nb_frames * nb_channels);
   if (canceled) {
     return 0;
   }
@@ -727,14 +780,100 @@ cleanup:
   return 1;
 }
 
+int FFmpegAudioDecoder::seek(std::int64_t timestamp) {
+  return seek_frame(av_rescale(timestamp, dst_sample_rate_, 1000));
+}
+
+int FFmpegAudioDecoder::seek_frame(std::int64_t frame) {
+  AVStream *stream = input_format_context_->streams[audio_stream_idx_];
+  const std::int64_t start_time =
+      stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+  const std::int64_t target =
+      start_time + av_rescale_q(frame, AVRational{1, dst_sample_rate_},
+                                stream->time_base);
+  const std::int64_t seek_ts = std::max(
+      start_time,
+      target - av_rescale_q(kSeekPrerollMs, AVRational{1, 1000},
+                            stream->time_base));
+  int error;
+
+  /* Demuxers without an index of their own get the cached packet index, so
+   * only the first seek into a file has to scan it. Sources have no path to
+   * cache it under. */
+  if (!seek_index_ &&
+      !(input_format_context_->flags & AVFMT_FLAG_CUSTOM_IO) &&
+      (input_format_context_->iformat->flags & AVFMT_GENERIC_INDEX)) {
+    if ((seek_index_ = load_seek_index(path_, audio_stream_idx_))) {
+      for (const SeekPoint &point : seek_index_->points) {
+        if (point.pos >= 0)
+          av_add_index_entry(stream, point.pos, point.pts, 0, 0,
+                             AVINDEX_KEYFRAME);
+      }
+    }
+  }
+
+  if ((error = av_seek_frame(input_format_context_, audio_stream_idx_,
+                             seek_ts, AVSEEK_FLAG_BACKWARD)) < 0) {
+    fprintf(stderr, "Could not seek to frame %lld (error '%s')\n",
+            static_cast<long long>(frame), av_err2str(error));
+    return error;
+  }
+
+  /* Forget everything decoded before the seek. */
+  avcodec_flush_buffers(input_codec_context_);
+  if ((error = converter_.reset()) < 0) {
+    fprintf(stderr, "Could not reset resample context\n");
+    return error;
+  }
+  ring_.reset();
+  finished_ = 0;
+  seek_target_frame_ = frame;
+  skip_nb_samples_ = 0;
+  return 1;
+}
+
+std::int64_t FFmpegAudioDecoder::duration() {
+  const AVStream *stream = input_format_context_->streams[audio_stream_idx_];
+  if (stream->duration != AV_NOPTS_VALUE) {
+    return av_rescale_q(stream->duration, stream->time_base,
+                        AVRational{1, 1000});
+  }
+  if (input_format_context_->duration != AV_NOPTS_VALUE) {
+    return av_rescale(input_format_context_->duration, 1000, AV_TIME_BASE);
+  }
+  return -1;
+}
+
+int FFmpegAudioDecoder::decode_range(std::int64_t start,
+                                     std::size_t nb_frames,
+                                     Waveform &waveform) {
+  int ret = seek(start);
+  if (ret <= 0) {
+    return ret;
+  }
+  return decode_into(waveform, nb_frames);
+}
+
+int FFmpegAudioDecoder::decode(std::unique_ptr<Waveform> &result,
+                               std::size_t max_frame_size,
+                               std::pmr::memory_resource *memory) {
+  auto waveform = std::make_unique<Waveform>(
+      Waveform::with_resource(dst_ch_layout_.nb_channels, memory));
+
+  int ret = decode_into(*waveform, max_frame_size);
+  if (ret > 0 && waveform->nb_frames > 0) {
+    result = std::move(waveform);
+  }
+  return ret;
+}
+
 FFmpegAudioDecoder::~FFmpegAudioDecoder() {
-  if (fifo_)
-    av_audio_fifo_free(fifo_);
-  swr_free(&resample_context_);
+  pool_->release_samples(converted_samples_);
+  pool_->release_frame(frame_);
+  pool_->release_packet(packet_);
   if (input_codec_context_)
     avcodec_free_context(&input_codec_context_);
-  if (input_format_context_)
-    avformat_close_input(&input_format_context_);
+  avpro::close_input(&input_format_context_);
 }
 
 } // namespace codec
@@ -4,14 +4,20 @@
 extern "C" {
 #include "libavcodec/avcodec.h"
 #include "libavformat/avformat.h"
-#include "libavutil/audio_fifo.h"
 #include "libavutil/channel_layout.h"
 #include "libavutil/samplefmt.h"
 #include "libswresample/swresample.h"
 }
 
 #include "common.h"
+#include "favutil/io.h"
+#include "favutil/pool.h"
+#include "favutil/stream_info.h"
+#include "ffmpeg_audio_index.h"
+#include "sample_converter.h"
+#include "sample_ring.h"
 #include "waveform.h"
+#include <atomic>
 #include <memory>
 
 namespace spleeter {
@@ -23,32 +29,79 @@ class FFmpegAudioDecoder {
   AVChannelLayout dst_ch_layout_;
   CancelToken *cancel_token_;
   std::string path_;
+  std::shared_ptr<avpro::MediaPool> pool_;
 
   AVFormatContext *input_format_context_{nullptr};
   int audio_stream_idx_ = {-1};
-  SwrContext *resample_context_{nullptr};
+  SampleConverter converter_;
   AVCodecContext *input_codec_context_{nullptr};
-  AVAudioFifo *fifo_{nullptr};
+  /// converted samples that did not fit the caller's waveform
+  SampleRing ring_;
+  AVPacket *packet_{nullptr};
+  AVFrame *frame_{nullptr};
+  avpro::PooledSamples converted_samples_;
   int finished_{0};
+  /// demux statistics, atomic so wrappers may report them from other threads
+  std::atomic<std::int64_t> bytes_read_{0};
+  std::atomic<std::int64_t> bytes_used_{0};
+
+  std::shared_ptr<const SeekIndex> seek_index_;
+  /// target frame of the last seek, until the first frame is decoded
+  std::int64_t seek_target_frame_{-1};
+  /// converted samples still to drop before the seek target
+  std::size_t skip_nb_samples_{0};
+
+  /// Convert frame into waveform at nb_frames, never past end_frame.
+  int convert_into(const AVFrame *frame, Waveform &waveform,
+                   std::size_t &nb_frames, std::size_t end_frame);
 
 public:
   FFmpegAudioDecoder(std::string path, int dst_sample_rate,
                      AVSampleFormat dst_sample_fmt,
                      const AVChannelLayout &dst_ch_layout,
-                     CancelToken *cancel_token);
+                     CancelToken *cancel_token,
+                     std::shared_ptr<avpro::MediaPool> pool);
 
+  /// fast_open trades the full stream probe for a short one, or none at all
+  /// when the same file was opened before, for time-to-first-sample.
   static std::unique_ptr<FFmpegAudioDecoder>
   create(std::string path, int dst_sample_rate, AVSampleFormat dst_sample_fmt,
-         const AVChannelLayout &dst_ch_layout, CancelToken *cancel_token);
+         const AVChannelLayout &dst_ch_layout, CancelToken *cancel_token,
+         std::shared_ptr<avpro::MediaPool> pool = nullptr,
+         const avpro::InputSource *source = nullptr, bool fast_open = false);
+
+  int decode(std::unique_ptr<Waveform> &result, std::size_t max_frame_size,
+             std::pmr::memory_resource *memory = sample_memory());
+
+  /// Decode up to max_frame_size frames into the caller's waveform, reusing
+  /// its storage. nb_frames is 0 once the input is exhausted.
+  int decode_into(Waveform &waveform, std::size_t max_frame_size);
 
-  // int decode(std::string path, const std::int64_t start,
-  //            const std::int64_t duration, std::unique_ptr<Waveform> &result,
-  //            ProgressCallback progress_callback);
+  /// Same as decode_into, but the frames are added after the waveform.nb_frames
+  /// frames already in it.
+  int decode_append(Waveform &waveform, std::size_t max_frame_size);
 
-  int decode(std::unique_ptr<Waveform> &result, std::size_t max_frame_size);
+  /// Position the decoder so the next decoded sample is the one at timestamp
+  /// (milliseconds from the start of the stream).
+  int seek(std::int64_t timestamp);
+
+  /// Same as seek, with the position given in frames at the output rate.
+  int seek_frame(std::int64_t frame);
+
+  /// Decode exactly nb_frames frames (fewer at end of input) from start
+  /// (milliseconds).
+  int decode_range(std::int64_t start, std::size_t nb_frames,
+                   Waveform &waveform);
 
   bool finished() { return finished_; }
 
+  /// Duration of the audio stream in milliseconds, -1 if unknown.
+  std::int64_t duration();
+
+  /// Input bytes read so far against the audio payload decoded from them,
+  /// safe to call while another thread decodes.
+  avpro::DemuxStats demux_stats() const;
+
   ~FFmpegAudioDecoder();
 };
 } // namespace codec
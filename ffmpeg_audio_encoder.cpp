@@ -10,121 +10,79 @@
 
 namespace spleeter {
 namespace codec {
-class FramesManager {
-  AVAudioFifo *audio_fifo_{nullptr};
-  AVSampleFormat sample_fmt_;
-  AVChannelLayout *channel_layout_;
-  int sample_rate_;
-
-public:
-  FramesManager(AVSampleFormat sample_fmt, AVChannelLayout *channel_layout,
-                int sample_rate)
-      : sample_fmt_(sample_fmt), channel_layout_(channel_layout),
-        sample_rate_(sample_rate) {}
-
-  int alloc(const Waveform &waveform) {
-    AVAudioFifo *fifo = av_audio_fifo_alloc(
-        sample_fmt_, channel_layout_->nb_channels, waveform.nb_frames);
-    if (!fifo) {
-      return -1;
-    }
-
-    void *dd =
-        reinterpret_cast<void *>(const_cast<float *>(waveform.data.data()));
-    if (av_audio_fifo_write(fifo, &dd, waveform.nb_frames) < 0) {
-      av_audio_fifo_free(fifo);
-      return -1;
-    }
-    audio_fifo_ = fifo;
-    return 0;
-  }
-
-  int read(AVFrame *frame, int max_samples, int *data_present, int *finished) {
-    assert(audio_fifo_);
-
-    *data_present = 0;
-    *finished = 0;
-
-    auto fifo_size = av_audio_fifo_size(audio_fifo_);
-
-    if (fifo_size == 0) {
-      *finished = 1;
-      return 0;
-    }
-
-    int nb_samples =
-        max_samples < 0 ? fifo_size : std::min(fifo_size, max_samples);
-
-    frame->nb_samples = nb_samples;
-    frame->format = sample_fmt_;
-    frame->sample_rate = sample_rate_;
-    av_channel_layout_copy(&frame->ch_layout, channel_layout_);
-
-    if (av_frame_get_buffer(frame, 0) < 0) {
-      return -1;
-    }
-
-    int nb = av_audio_fifo_read(audio_fifo_, (void **)frame->data,
-                                frame->nb_samples);
-
-    if (nb > 0) {
-      *data_present = 1;
-      return 0;
-    }
-    if (nb == 0) {
-      *finished = 1;
-      return 0;
+/* Prefer the source format, then its planar or packed twin, so the encoder
+ * input needs at most an (de)interleave instead of a resampler. */
+static AVSampleFormat negotiate_sample_fmt(const AVCodec *codec,
+                                           AVSampleFormat sample_fmt) {
+  const AVSampleFormat candidates[] = {
+      sample_fmt,
+      av_sample_fmt_is_planar(sample_fmt)
+          ? av_get_packed_sample_fmt(sample_fmt)
+          : av_get_planar_sample_fmt(sample_fmt),
+  };
+  if (!codec->sample_fmts) {
+    return sample_fmt;
+  }
+  for (AVSampleFormat candidate : candidates) {
+    for (const AVSampleFormat *p = codec->sample_fmts; *p != AV_SAMPLE_FMT_NONE;
+         ++p) {
+      if (*p == candidate) {
+        return candidate;
+      }
     }
-
-    return -1;
   }
+  return codec->sample_fmts[0];
+}
 
-  ~FramesManager() {
-    if (audio_fifo_) {
-      av_audio_fifo_free(audio_fifo_);
-      audio_fifo_ = nullptr;
-    }
-  }
-};
+/// Microseconds of audio per fragment of an MP4 written without seeking.
+static constexpr int64_t kFragmentDuration = 1000000;
 
-static int open_output_file(const char *filename, int sample_rate,
-                            AVSampleFormat sample_fmt, int nb_channels,
-                            int bitrate,
-                            AVFormatContext **output_format_context,
-                            AVCodecContext **output_codec_context) {
+int open_output_file(const char *filename, int sample_rate,
+                     AVSampleFormat sample_fmt, int nb_channels, int bitrate,
+                     AVFormatContext **output_format_context,
+                     AVCodecContext **output_codec_context,
+                     const avpro::OutputSink *sink) {
   AVCodecContext *avctx = NULL;
-  AVIOContext *output_io_context = NULL;
   AVStream *stream = NULL;
   const AVCodec *output_codec = NULL;
   int error;
 
-  /* Open the output file to write to it. */
-  if ((error = avio_open(&output_io_context, filename, AVIO_FLAG_WRITE)) < 0) {
-    fprintf(stderr, "Could not open output file '%s' (error '%s')\n", filename,
+  /* Create a new format context for the output container format, named by
+   * the sink or guessed from the file extension. */
+  if ((error = avformat_alloc_output_context2(
+           output_format_context, NULL,
+           sink && !sink->format.empty() ? sink->format.c_str() : NULL,
+           filename)) < 0) {
+    fprintf(stderr, "Could not find output file format (error '%s')\n",
             av_err2str(error));
     return error;
   }
 
-  /* Create a new format context for the output container format. */
-  if (!(*output_format_context = avformat_alloc_context())) {
-    fprintf(stderr, "Could not allocate output format context\n");
-    return AVERROR(ENOMEM);
-  }
-
-  /* Associate the output file (pointer) with the container format context. */
-  (*output_format_context)->pb = output_io_context;
-
-  /* Guess the desired container format based on the file extension. */
-  if (!((*output_format_context)->oformat =
-            av_guess_format(NULL, filename, NULL))) {
-    fprintf(stderr, "Could not find output file format\n");
+  /* Open the output file or the sink to write to it. */
+  if (sink) {
+    if (!((*output_format_context)->pb = avpro::open_output_io(*sink))) {
+      fprintf(stderr, "Could not allocate output context\n");
+      error = AVERROR(ENOMEM);
+      goto cleanup;
+    }
+    (*output_format_context)->flags |= AVFMT_FLAG_CUSTOM_IO;
+  } else if ((error = avio_open(&(*output_format_context)->pb, filename,
+                                AVIO_FLAG_WRITE)) < 0) {
+    fprintf(stderr, "Could not open output file '%s' (error '%s')\n", filename,
+            av_err2str(error));
     goto cleanup;
   }
 
-  if (!((*output_format_context)->url = av_strdup(filename))) {
-    fprintf(stderr, "Could not allocate url.\n");
-    error = AVERROR(ENOMEM);
-    goto cleanup;
+  /* MP4 writes its index at the end by seeking back to the header, without
+   * seeking it has to be fragmented. frag_keyframe only cuts at video
+   * keyframes, so audio alone is cut every kFragmentDuration instead, or the
+   * muxer would hold the whole file until the trailer. Other muxers have no
+   * such options. */
+  if (!((*output_format_context)->pb->seekable & AVIO_SEEKABLE_NORMAL)) {
+    av_opt_set(*output_format_context, "movflags",
+               "+empty_moov+default_base_moof", AV_OPT_SEARCH_CHILDREN);
+    av_opt_set_int(*output_format_context, "frag_duration", kFragmentDuration,
+                   AV_OPT_SEARCH_CHILDREN);
   }
 
   /* Find the encoder to be used by its name. */
@@ -152,7 +110,7 @@ static int open_output_file(const char *filename, int sample_rate,
    * The input file's sample rate is used to avoid a sample rate conversion. */
   av_channel_layout_default(&avctx->ch_layout, nb_channels);
   avctx->sample_rate = sample_rate;
-  avctx->sample_fmt = output_codec->sample_fmts[0];
+  avctx->sample_fmt = negotiate_sample_fmt(output_codec, sample_fmt);
   if (bitrate > 0) {
     avctx->bit_rate = bitrate;
   }
@@ -186,10 +144,21 @@ static int open_output_file(const char *filename, int sample_rate,
 
 cleanup:
   avcodec_free_context(&avctx);
-  avio_closep(&(*output_format_context)->pb);
+  close_output_file(output_format_context);
+  return error < 0 ? error : AVERROR_EXIT;
+}
+
+void close_output_file(AVFormatContext **output_format_context) {
+  if (!*output_format_context) {
+    return;
+  }
+  if ((*output_format_context)->flags & AVFMT_FLAG_CUSTOM_IO) {
+    avpro::close_io(&(*output_format_context)->pb);
+  } else {
+    avio_closep(&(*output_format_context)->pb);
+  }
   avformat_free_context(*output_format_context);
   *output_format_context = NULL;
-  return error < 0 ? error : AVERROR_EXIT;
 }
 
 /**
@@ -197,7 +166,7 @@ cleanup:
  * @param output_format_context Format context of the output file
  * @return Error code (0 if successful)
  */
-static int write_output_file_header(AVFormatContext *output_format_context) {
+int write_output_file_header(AVFormatContext *output_format_context) {
   int error;
   if ((error = avformat_write_header(output_format_context, NULL)) < 0) {
     fprintf(stderr, "Could not write output file header (error '%s')\n",
@@ -207,125 +176,19 @@ static int write_output_file_header(AVFormatContext *output_format_context) {
   return 0;
 }
 
-static int convert_samples(const uint8_t **input_data, uint8_t **converted_data,
-                           const int frame_size, SwrContext *resample_context) {
-  int error;
-
-  /* Convert the samples using the resampler. */
-  if ((error = swr_convert(resample_context, converted_data, frame_size,
-                           input_data, frame_size)) < 0) {
-    fprintf(stderr, "Could not convert input samples (error '%s')\n",
-            av_err2str(error));
-    return error;
-  }
-
-  return 0;
-}
-
-static int read_decode_convert_and_store(AVAudioFifo *fifo,
-                                         AVCodecContext *output_codec_context,
-                                         SwrContext *resampler_context,
-                                         int *finished,
-                                         FramesManager &frame_manager) {
-
-  /* Temporary storage of the input samples of the frame read from the file. */
-  AVFrame *input_frame = NULL;
-
-  /* Temporary storage for the converted input samples. */
-  uint8_t **converted_input_samples = NULL;
-  int data_present;
-  int ret = AVERROR_EXIT;
-
-  /* Initialize temporary storage for one input frame. */
-  if (init_input_frame(&input_frame))
-    goto cleanup;
-
-  if (frame_manager.read(input_frame, 2048, &data_present, finished)) {
-    goto cleanup;
-  }
-  if (*finished) {
-    ret = 0;
-    goto cleanup;
-  }
-
-  /* If there is decoded data, convert and store it. */
-  if (data_present) {
-    /* Initialize the temporary storage for the converted input samples. */
-    if (init_converted_samples(&converted_input_samples,
-                               output_codec_context->ch_layout.nb_channels,
-                               input_frame->nb_samples,
-                               output_codec_context->sample_fmt))
-      goto cleanup;
-
-    if (convert_samples((const uint8_t **)input_frame->extended_data,
-                        converted_input_samples, input_frame->nb_samples,
-                        resampler_context))
-      goto cleanup;
-
-    /* Add the converted input samples to the FIFO buffer for later processing.
-     */
-    if (add_samples_to_fifo(fifo, converted_input_samples,
-                            input_frame->nb_samples))
-      goto cleanup;
-    ret = 0;
-  }
-  ret = 0;
-
-cleanup:
-  if (converted_input_samples) {
-    av_freep(&converted_input_samples[0]);
-    // free(converted_input_samples);
-    delete[] converted_input_samples;
-  }
-  av_frame_free(&input_frame);
-  return ret;
-}
-
-static int init_output_frame(AVFrame **frame,
-                             AVCodecContext *output_codec_context,
-                             int frame_size) {
-  int error;
-
-  /* Create a new frame to store the audio samples. */
-  if (!(*frame = av_frame_alloc())) {
-    fprintf(stderr, "Could not allocate output frame\n");
-    return AVERROR_EXIT;
-  }
-
-  /* Set the frame's parameters, especially its size and format.
-   * av_frame_get_buffer needs this to allocate memory for the
-   * audio samples of the frame.
-   * Default channel layouts based on the number of channels
-   * are assumed for simplicity. */
-  (*frame)->nb_samples = frame_size;
-  av_channel_layout_copy(&(*frame)->ch_layout,
-                         &output_codec_context->ch_layout);
-  (*frame)->format = output_codec_context->sample_fmt;
-  (*frame)->sample_rate = output_codec_context->sample_rate;
-
-  /* Allocate the samples of the created frame. This call will make
-   * sure that the audio frame can hold as many samples as specified. */
-  if ((error = av_frame_get_buffer(*frame, 0)) < 0) {
-    fprintf(stderr, "Could not allocate output frame samples (error '%s')\n",
-            av_err2str(error));
-    av_frame_free(frame);
-    return error;
-  }
-
-  return 0;
-}
-
 static int encode_audio_frame(AVFrame *frame,
                               AVFormatContext *output_format_context,
                               AVCodecContext *output_codec_context,
-                              int *data_present, int64_t &pts) {
+                              int *data_present, int64_t &pts,
+                              avpro::MediaPool &pool) {
   /* Packet used for temporary storage. */
   AVPacket *output_packet;
   int error;
 
-  error = init_packet(&output_packet);
-  if (error < 0)
-    return error;
+  if (!(output_packet = pool.acquire_packet())) {
+    fprintf(stderr, "Could not allocate packet\n");
+    return AVERROR(ENOMEM);
+  }
 
   /* Set a timestamp based on the sample rate for the container. */
   if (frame) {
@@ -372,55 +235,25 @@ static int encode_audio_frame(AVFrame *frame,
   }
 
 cleanup:
-  av_packet_free(&output_packet);
+  pool.release_packet(output_packet);
   return error;
 }
 
-inline int get_output_frame_size(AVCodecContext *output_codec_context) {
-  if (output_codec_context->codec_id == AV_CODEC_CAP_VARIABLE_FRAME_SIZE) {
-    return 1024;
-  } else {
-    return output_codec_context->frame_size;
-  }
-}
-static int load_encode_and_write(AVAudioFifo *fifo,
-                                 AVFormatContext *output_format_context,
-                                 AVCodecContext *output_codec_context,
-                                 int64_t &pts) {
-  /* Temporary storage of the output samples of the frame written to the file.
-   */
-  AVFrame *output_frame;
-  /* Use the maximum number of possible samples per frame.
-   * If there is less than the maximum possible frame size in the FIFO
-   * buffer use this number. Otherwise, use the maximum possible frame size. */
-  const int frame_size = FFMIN(av_audio_fifo_size(fifo),
-                               get_output_frame_size(output_codec_context));
-  int data_written;
-
-  /* Initialize temporary storage for one output frame. */
-  if (init_output_frame(&output_frame, output_codec_context, frame_size))
-    return AVERROR_EXIT;
-
-  /* Read as many samples from the FIFO buffer as required to fill the frame.
-   * The samples are stored in the frame temporarily. */
-  if (av_audio_fifo_read(fifo, (void **)output_frame->data, frame_size) <
-      frame_size) {
-    fprintf(stderr, "Could not read data from FIFO\n");
-    av_frame_free(&output_frame);
-    return AVERROR_EXIT;
-  }
+/// Frames of a view passed to write_samples at once, keeps counts in int.
+static constexpr int kMaxWriteSize = 1 << 24;
 
-  /* Encode one frame worth of audio samples. */
-  if (encode_audio_frame(output_frame, output_format_context,
-                         output_codec_context, &data_written, pts)) {
-    av_frame_free(&output_frame);
-    return AVERROR_EXIT;
+/* Encoders without a fixed frame size (PCM) take any, 1024 keeps the
+ * packets small. */
+int get_output_frame_size(const AVCodecContext *output_codec_context) {
+  if (output_codec_context->frame_size <= 0 ||
+      (output_codec_context->codec->capabilities &
+       AV_CODEC_CAP_VARIABLE_FRAME_SIZE)) {
+    return 1024;
   }
-  av_frame_free(&output_frame);
-  return 0;
+  return output_codec_context->frame_size;
 }
 
-static int write_output_file_trailer(AVFormatContext *output_format_context) {
+int write_output_file_trailer(AVFormatContext *output_format_context) {
   int error;
   if ((error = av_write_trailer(output_format_context)) < 0) {
     fprintf(stderr, "Could not write output file trailer (error '%s')\n",
@@ -567,10 +400,12 @@ inline void check_cancel_and_throw(CancelToken &cancel_token) {
 FFmpegAudioEncoder::FFmpegAudioEncoder(std::string path, int src_sample_rate,
                                        AVSampleFormat src_sample_fmt,
                                        const AVChannelLayout &src_ch_layout,
-                                       int bitrate, CancelToken *cancel_token)
+                                       int bitrate, CancelToken *cancel_token,
+                                       std::shared_ptr<avpro::MediaPool> pool)
     : path_(path), src_sample_rate_(src_sample_rate),
       src_sample_fmt_(src_sample_fmt), bitrate_(bitrate),
-      cancel_token_(cancel_token) {
+      cancel_token_(cancel_token),
+      pool_(pool ? std::move(pool) : std::make_shared<avpro::MediaPool>()) {
   av_channel_layout_copy(&src_ch_layout_, &src_ch_layout);
   // frame_manager_ = std::make_unique<FramesManager>(
   //     src_sample_fmt, &src_ch_layout_, src_sample_rate);
@@ -580,27 +415,40 @@ std::unique_ptr<FFmpegAudioEncoder>
 FFmpegAudioEncoder::create(std::string path, int src_sample_rate,
                            AVSampleFormat src_sample_fmt,
                            const AVChannelLayout &src_ch_layout, int bitrate,
-                           CancelToken *cancel_token) {
+                           CancelToken *cancel_token,
+                           std::shared_ptr<avpro::MediaPool> pool,
+                           const avpro::OutputSink *sink) {
   auto encoder = std::make_unique<FFmpegAudioEncoder>(
       path, src_sample_rate, src_sample_fmt, src_ch_layout, bitrate,
-      cancel_token);
+      cancel_token, std::move(pool));
   /* Open the output file for writing. */
   if ((open_output_file(path.c_str(), src_sample_rate, src_sample_fmt,
                         src_ch_layout.nb_channels, bitrate,
                         &encoder->output_format_context_,
-                        &encoder->output_codec_context_)))
+                        &encoder->output_codec_context_, sink)))
     return nullptr;
 
-  if (init_resampler(&src_ch_layout, src_sample_fmt, src_sample_rate,
+  if (init_converter(&src_ch_layout, src_sample_fmt, src_sample_rate,
                      &encoder->output_codec_context_->ch_layout,
                      encoder->output_codec_context_->sample_fmt,
                      encoder->output_codec_context_->sample_rate,
-                     &encoder->resample_context_))
+                     encoder->converter_))
     return nullptr;
 
-  if (init_fifo(&encoder->fifo_, encoder->output_codec_context_->sample_fmt,
-                encoder->output_codec_context_->ch_layout.nb_channels, 1))
+  /* The one frame every encode call converts into, reused for the whole
+   * stream. */
+  if (!(encoder->frame_ = encoder->pool_->acquire_audio_frame(
+            &encoder->output_codec_context_->ch_layout,
+            encoder->output_codec_context_->sample_fmt,
+            encoder->output_codec_context_->sample_rate,
+            get_output_frame_size(encoder->output_codec_context_)))) {
+    fprintf(stderr, "Could not allocate output frame\n");
     return nullptr;
+  }
+  encoder->output_planes_.resize(
+      av_sample_fmt_is_planar(encoder->output_codec_context_->sample_fmt)
+          ? encoder->output_codec_context_->ch_layout.nb_channels
+          : 1);
 
   /* Write the header of the output file container. */
   if ((write_output_file_header(encoder->output_format_context_)))
@@ -608,96 +456,172 @@ FFmpegAudioEncoder::create(std::string path, int src_sample_rate,
   return encoder;
 }
 
-int FFmpegAudioEncoder::encode(const Waveform &waveform) {
+AVSampleFormat
+FFmpegAudioEncoder::codec_sample_fmt(const std::string &path,
+                                     AVSampleFormat src_sample_fmt) {
+  const AVOutputFormat *oformat = av_guess_format(NULL, path.c_str(), NULL);
+  const AVCodec *codec;
+
+  if (!oformat || !(codec = avcodec_find_encoder(oformat->audio_codec))) {
+    return AV_SAMPLE_FMT_NONE;
+  }
+  return negotiate_sample_fmt(codec, src_sample_fmt);
+}
+
+int FFmpegAudioEncoder::send_frame(int nb_samples) {
+  int data_written;
+
+  frame_->nb_samples = nb_samples;
+  frame_fill_ = 0;
+  return encode_audio_frame(frame_, output_format_context_,
+                            output_codec_context_, &data_written, pts,
+                            *pool_);
+}
+
+int FFmpegAudioEncoder::convert_into_frame(const uint8_t **input_data,
+                                           int input_nb_samples) {
+  const int frame_size = get_output_frame_size(output_codec_context_);
+  const AVSampleFormat sample_fmt = output_codec_context_->sample_fmt;
+  const int nb_channels = output_codec_context_->ch_layout.nb_channels;
+  const bool planar = av_sample_fmt_is_planar(sample_fmt);
+  const int nb_planes = planar ? nb_channels : 1;
+  const int bytes_per_frame =
+      av_get_bytes_per_sample(sample_fmt) * (planar ? 1 : nb_channels);
+  uint8_t **output_data = output_planes_.data();
+  int error;
+
+  /* The encoder may still reference the frame, writing needs it to own
+   * its buffers. */
+  if (frame_fill_ == 0) {
+    frame_->nb_samples = frame_size;
+    if ((error = av_frame_make_writable(frame_)) < 0)
+      return error;
+  }
+  assert(output_planes_.size() == static_cast<std::size_t>(nb_planes));
+  for (int i = 0; i < nb_planes; ++i) {
+    output_data[i] = frame_->extended_data[i] + frame_fill_ * bytes_per_frame;
+  }
+
+  if ((error = converter_.convert(output_data, frame_size - frame_fill_,
+                                  input_data, input_nb_samples)) < 0) {
+    fprintf(stderr, "Could not convert input samples (error '%s')\n",
+            av_err2str(error));
+    return error;
+  }
+  frame_fill_ += error;
+  if (frame_fill_ == frame_size && (error = send_frame(frame_size)) < 0) {
+    return error;
+  }
+  return 0;
+}
+
+int FFmpegAudioEncoder::write_samples(const uint8_t *data, int nb_samples) {
+  const int frame_size = get_output_frame_size(output_codec_context_);
+  const int bytes_per_frame =
+      av_get_bytes_per_sample(src_sample_fmt_) * src_ch_layout_.nb_channels;
+  const int dst_sample_rate = output_codec_context_->sample_rate;
+  int error;
+
+  while (nb_samples > 0) {
+    /* Hand over about as many samples as fit into the frame, so the
+     * resampler never has to hold more than a frame. */
+    const int space = frame_size - frame_fill_;
+    const int n = std::min<int>(
+        nb_samples,
+        std::max<std::int64_t>(
+            1, av_rescale(space, src_sample_rate_, dst_sample_rate)));
+    const uint8_t *input_data[1] = {data};
+    if ((error = convert_into_frame(input_data, n)) < 0)
+      return error;
+    data += static_cast<std::size_t>(n) * bytes_per_frame;
+    nb_samples -= n;
+  }
+
+  /* Take out whole frames the resampler still holds. */
+  while (converter_.mode() == SampleConverter::Mode::kResample &&
+         converter_.get_out_samples(0) >= frame_size - frame_fill_) {
+    const uint8_t *input_data[1] = {data};
+    const int fill = frame_fill_;
+    if ((error = convert_into_frame(input_data, 0)) < 0)
+      return error;
+    if (frame_fill_ == fill) {
+      break;
+    }
+  }
+  return 0;
+}
 
+int FFmpegAudioEncoder::encode(const WaveformView &waveform) {
+  assert(waveform.nb_channels == src_ch_layout_.nb_channels);
   int ret = AVERROR_EXIT;
   bool canceled = false;
-  int waveform_data_size = waveform.data.size();
-  int waveform_data_nb_frames = waveform.nb_frames;
   try {
-    // FramesManager &frame_manager = *frame_manager_;
     auto &cancel_token = *cancel_token_;
-    auto &path = path_;
-    auto &src_sample_rate = src_sample_rate_;
-    auto &src_sample_fmt = src_sample_fmt_;
-    auto &src_ch_layout = src_ch_layout_;
-    auto &bitrate = bitrate_;
-
-    AVFormatContext *&output_format_context = output_format_context_;
-    AVCodecContext *&output_codec_context = output_codec_context_;
-    SwrContext *&resample_context = resample_context_;
-    AVAudioFifo *fifo = fifo_;
     check_cancel_and_throw(cancel_token);
 
-    FramesManager frame_manager(src_sample_fmt, &src_ch_layout_,
-                                src_sample_rate);
-
-    if (frame_manager.alloc(waveform)) {
-      return -1;
-    }
-    check_cancel_and_throw(cancel_token);
-
-    // #if SPLEETER_ENABLE_PROGRESS_CALLBACK
-    //     auto progress_fun = [&]() {
-    //       auto now_progress_timestamp = get_current_timestamp();
-    //       auto x = now_progress_timestamp - last_progress_timestamp;
-    //       if (x.count() > 500) {
-    //         progress_callback(
-    //             av_rescale(pts, 1000, output_codec_context->sample_rate));
-    //         last_progress_timestamp = now_progress_timestamp;
-    //       }
-    //     };
-    // #endif
-    while (1) {
-      const int output_frame_size = get_output_frame_size(output_codec_context);
-      int finished = 0;
-
-      while (av_audio_fifo_size(fifo) < output_frame_size) {
-        if (read_decode_convert_and_store(fifo, output_codec_context,
-                                          resample_context, &finished,
-                                          frame_manager))
+    /* Samples go from the view through the converter straight into the
+     * encoder frame. A strided view is first packed into gathered_, one
+     * encoder frame at a time. */
+    if (waveform.contiguous()) {
+      for (std::size_t i = 0; i < waveform.nb_frames; i += kMaxWriteSize) {
+        const int n = static_cast<int>(
+            std::min<std::size_t>(kMaxWriteSize, waveform.nb_frames - i));
+        const uint8_t *data =
+            reinterpret_cast<const uint8_t *>(waveform.frame(i));
+        if ((ret = write_samples(data, n)) < 0)
           goto cleanup;
         check_cancel_and_throw(cancel_token);
-
-        if (finished)
-          break;
       }
-
-      while (av_audio_fifo_size(fifo) >= output_frame_size) {
-        /* Take one frame worth of audio samples from the FIFO buffer,
-         * encode it and write it to the output file. */
-        if (load_encode_and_write(fifo, output_format_context,
-                                  output_codec_context, pts))
+    } else {
+      const std::size_t block = get_output_frame_size(output_codec_context_);
+      gathered_.resize(block * waveform.nb_channels);
+      for (std::size_t i = 0; i < waveform.nb_frames; i += block) {
+        const std::size_t n = std::min(block, waveform.nb_frames - i);
+        float *p = gathered_.data();
+        for (std::size_t j = i; j < i + n; ++j) {
+          const float *frame = waveform.frame(j);
+          p = std::copy(frame, frame + waveform.nb_channels, p);
+        }
+        const uint8_t *data =
+            reinterpret_cast<const uint8_t *>(gathered_.data());
+        if ((ret = write_samples(data, static_cast<int>(n))) < 0)
           goto cleanup;
         check_cancel_and_throw(cancel_token);
-        // #if SPLEETER_ENABLE_PROGRESS_CALLBACK
-        //         progress_fun();
-        // #endif
       }
+    }
 
-      // while (av_audio_fifo_size(fifo) >= output_frame_size ||
-      //        (finished && av_audio_fifo_size(fifo) > 0)) {
-      //   /* Take one frame worth of audio samples from the FIFO buffer,
-      //    * encode it and write it to the output file. */
-      //   if (load_encode_and_write(fifo, output_format_context,
-      //                             output_codec_context, pts))
-      //     goto cleanup;
-      //   check_cancel_and_throw(cancel_token);
-      //   // #if SPLEETER_ENABLE_PROGRESS_CALLBACK
-      //   //         progress_fun();
-      //   // #endif
-      // }
-
-      /* If we are at the end of the input file and have encoded
-       * all remaining samples, we can exit this loop and finish. */
-      if (finished) {
+    ret = 0;
+  } catch (const CancelException &) {
+    canceled = true;
+  }
 
-        break;
-      }
-    }
+cleanup:
+  if (canceled) {
+    return 0;
+  }
+  if (ret < 0) {
+    return ret;
+  }
+  return 1;
+}
 
+int FFmpegAudioEncoder::encode(const uint8_t *data, std::size_t nb_samples) {
+  const std::size_t bytes_per_frame =
+      av_get_bytes_per_sample(src_sample_fmt_) * src_ch_layout_.nb_channels;
+  int ret = AVERROR_EXIT;
+  bool canceled = false;
+  try {
+    auto &cancel_token = *cancel_token_;
     check_cancel_and_throw(cancel_token);
 
+    for (std::size_t i = 0; i < nb_samples; i += kMaxWriteSize) {
+      const int n = static_cast<int>(
+          std::min<std::size_t>(kMaxWriteSize, nb_samples - i));
+      if ((ret = write_samples(data + i * bytes_per_frame, n)) < 0)
+        goto cleanup;
+      check_cancel_and_throw(cancel_token);
+    }
+
     ret = 0;
   } catch (const CancelException &) {
     canceled = true;
@@ -714,56 +638,57 @@ cleanup:
 }
 
 int FFmpegAudioEncoder::finish() {
-  auto &cancel_token = *cancel_token_;
-
-  AVFormatContext *&output_format_context = output_format_context_;
-  AVCodecContext *&output_codec_context = output_codec_context_;
-  AVAudioFifo *fifo = fifo_;
-
   int ret = AVERROR_EXIT;
+  bool canceled = false;
   int data_written;
 
-  while (av_audio_fifo_size(fifo) > 0) {
-    /* Take one frame worth of audio samples from the FIFO buffer,
-     * encode it and write it to the output file. */
-    if (load_encode_and_write(fifo, output_format_context, output_codec_context,
-                              pts))
+  try {
+    auto &cancel_token = *cancel_token_;
+    check_cancel_and_throw(cancel_token);
+
+    /* Drain the resampler delay, then send the short last frame. */
+    while (converter_.mode() == SampleConverter::Mode::kResample) {
+      const int fill = frame_fill_;
+      if ((ret = convert_into_frame(NULL, 0)) < 0)
+        goto cleanup;
+      if (frame_fill_ == fill) {
+        break;
+      }
+    }
+    if (frame_fill_ > 0 && (ret = send_frame(frame_fill_)) < 0)
       goto cleanup;
     check_cancel_and_throw(cancel_token);
-    // #if SPLEETER_ENABLE_PROGRESS_CALLBACK
-    //         progress_fun();
-    // #endif
-  }
 
-  /* Flush the encoder as it may have delayed frames. */
-  do {
-    if (encode_audio_frame(NULL, output_format_context, output_codec_context,
-                           &data_written, pts)) {
+    /* Flush the encoder as it may have delayed frames. */
+    do {
+      if ((ret = encode_audio_frame(NULL, output_format_context_,
+                                    output_codec_context_, &data_written, pts,
+                                    *pool_)) < 0)
+        goto cleanup;
+    } while (data_written);
+
+    if ((ret = write_output_file_trailer(output_format_context_)) < 0)
       goto cleanup;
-      check_cancel_and_throw(cancel_token);
-      // #if SPLEETER_ENABLE_PROGRESS_CALLBACK
-      //             progress_fun();
-      // #endif
-    }
-  } while (data_written);
+    ret = 0;
+  } catch (const CancelException &) {
+    canceled = true;
+  }
 
-  if (write_output_file_trailer(output_format_context))
-    goto cleanup;
-  ret = 1;
 cleanup:
-  return ret;
+  if (canceled) {
+    return 0;
+  }
+  if (ret < 0) {
+    return ret;
+  }
+  return 1;
 }
 
 FFmpegAudioEncoder::~FFmpegAudioEncoder() {
-  if (fifo_)
-    av_audio_fifo_free(fifo_);
-  swr_free(&resample_context_);
+  pool_->release_frame(frame_);
   if (output_codec_context_)
     avcodec_free_context(&output_codec_context_);
-  if (output_format_context_) {
-    avio_closep(&output_format_context_->pb);
-    avformat_free_context(output_format_context_);
-  }
+  close_output_file(&output_format_context_);
 }
 
 std::int64_t FFmpegAudioEncoder::last_timestamp() {
@@ -2,23 +2,47 @@
 #ifndef SPLEETER_FFMPEG_AUDIO_ENCODER_H
 #define SPLEETER_FFMPEG_AUDIO_ENCODER_H
 #include "common.h"
+#include "favutil/io.h"
+#include "favutil/pool.h"
+#include "sample_converter.h"
 #include "waveform.h"
 #include <cassert>
 #include <memory>
 #include <string>
+#include <vector>
 extern "C" {
 #include "libavutil/avassert.h"
 #include "libavutil/channel_layout.h"
 #include "libavutil/frame.h"
+#include "libavutil/opt.h"
 #include "libavutil/samplefmt.h"
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
-#include <libavutil/audio_fifo.h>
 #include <libswresample/swresample.h>
 }
 
 namespace spleeter {
 namespace codec {
+/// Opens filename with the container and encoder its extension names. The
+/// encoder runs at sample_rate, in sample_fmt or the closest format it takes.
+/// With a sink the bytes go there instead, filename only names the format if
+/// the sink does not.
+int open_output_file(const char *filename, int sample_rate,
+                     AVSampleFormat sample_fmt, int nb_channels, int bitrate,
+                     AVFormatContext **output_format_context,
+                     AVCodecContext **output_codec_context,
+                     const avpro::OutputSink *sink = nullptr);
+
+/// Closes the file or sink and frees the context.
+void close_output_file(AVFormatContext **output_format_context);
+
+int write_output_file_header(AVFormatContext *output_format_context);
+
+int write_output_file_trailer(AVFormatContext *output_format_context);
+
+/// Samples per frame the encoder is fed with.
+int get_output_frame_size(const AVCodecContext *output_codec_context);
+
 // int encode(const std::string &path, int src_sample_rate,
 //            AVSampleFormat src_sample_fmt, AVChannelLayout src_ch_layout,
 //            Waveform waveform, int bitrate, CancelToken &cancel_token,
@@ -31,29 +55,55 @@ class FFmpegAudioEncoder {
   int bitrate_;
   CancelToken *cancel_token_;
   std::string path_;
+  std::shared_ptr<avpro::MediaPool> pool_;
 
   AVFormatContext *output_format_context_ = NULL;
   AVCodecContext *output_codec_context_ = NULL;
-  SwrContext *resample_context_ = NULL;
-  AVAudioFifo *fifo_ = NULL;
-
-  //   std::unique_ptr<FramesManager> frame_manager_;
+  SampleConverter converter_;
+  /// encoder sized frame the input is converted into, also holds the
+  /// samples of a partial frame between two encode calls
+  AVFrame *frame_{nullptr};
+  /// samples already in frame_
+  int frame_fill_{0};
+  /// write positions inside frame_, one per plane
+  std::vector<uint8_t *> output_planes_;
+  /// frames of a strided view packed for write_samples, one frame_ worth
+  std::vector<float> gathered_;
 
   int64_t pts = {0};
 
+  int send_frame(int nb_samples);
+
+  /// Converts input_nb_samples samples into the free part of frame_ and
+  /// sends the frame once it is full. NULL input flushes the resampler.
+  int convert_into_frame(const uint8_t **input_data, int input_nb_samples);
+
+  int write_samples(const uint8_t *data, int nb_samples);
+
 public:
   FFmpegAudioEncoder(std::string path, int src_sample_rate,
                      AVSampleFormat src_sample_fmt,
                      const AVChannelLayout &src_ch_layout, int bitrate,
-                     CancelToken *cancel_token);
+                     CancelToken *cancel_token,
+                     std::shared_ptr<avpro::MediaPool> pool);
 
 public:
   static std::unique_ptr<FFmpegAudioEncoder>
   create(std::string path, int src_sample_rate, AVSampleFormat src_sample_fmt,
          const AVChannelLayout &src_ch_layout, int bitrate,
-         CancelToken *cancel_token);
+         CancelToken *cancel_token,
+         std::shared_ptr<avpro::MediaPool> pool = nullptr,
+         const avpro::OutputSink *sink = nullptr);
+
+  /// Sample format the encoder of path's container is fed with when the
+  /// input has src_sample_fmt, AV_SAMPLE_FMT_NONE if there is no encoder.
+  static AVSampleFormat codec_sample_fmt(const std::string &path,
+                                         AVSampleFormat src_sample_fmt);
+
+  int encode(const WaveformView &waveform);
 
-  int encode(const Waveform &waveform);
+  /// Encodes nb_samples packed samples in the source format given to create.
+  int encode(const uint8_t *data, std::size_t nb_samples);
 
   int finish();
 
@@ -0,0 +1,151 @@
+#include "ffmpeg_audio_index.h"
+#include "favutil/stream_info.h"
+#include <cstdio>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <mutex>
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+#include "libavutil/error.h"
+}
+
+namespace spleeter {
+namespace codec {
+
+/// Minimum distance between two index points, keeps the index small while
+/// bounding the samples decoded in vain after a seek.
+static constexpr std::int64_t kIndexIntervalMs = 250;
+/// Files indexed at most, the same bound as the stream probe cache.
+static constexpr std::size_t kMaxIndexedFiles = 1024;
+
+static int build_seek_index(const std::string &path, int stream_index,
+                            SeekIndex &index) {
+  AVFormatContext *input_format_context = NULL;
+  AVPacket *packet = NULL;
+  AVStream *stream;
+  std::int64_t interval;
+  int error;
+
+  if ((error = avformat_open_input(&input_format_context, path.c_str(), NULL,
+                                   NULL)) < 0) {
+    fprintf(stderr, "Could not open input file '%s' (error '%s')\n",
+            path.c_str(), av_err2str(error));
+    return error;
+  }
+  if ((error = avformat_find_stream_info(input_format_context, NULL)) < 0) {
+    fprintf(stderr, "Could not open find stream info (error '%s')\n",
+            av_err2str(error));
+    goto cleanup;
+  }
+  if (stream_index < 0 ||
+      stream_index >= static_cast<int>(input_format_context->nb_streams)) {
+    error = AVERROR(EINVAL);
+    goto cleanup;
+  }
+  if (!(packet = av_packet_alloc())) {
+    error = AVERROR(ENOMEM);
+    goto cleanup;
+  }
+
+  /* Only the packet headers of the audio stream are of interest. */
+  avpro::discard_other_streams(input_format_context, stream_index);
+
+  stream = input_format_context->streams[stream_index];
+  index.stream_index = stream_index;
+  index.time_base = stream->time_base;
+  interval = av_rescale_q(kIndexIntervalMs, AVRational{1, 1000},
+                          stream->time_base);
+
+  while ((error = av_read_frame(input_format_context, packet)) >= 0) {
+    if (packet->stream_index == stream_index &&
+        (packet->flags & AV_PKT_FLAG_KEY)) {
+      std::int64_t ts =
+          packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+      if (ts != AV_NOPTS_VALUE &&
+          (index.points.empty() || ts - index.points.back().pts >= interval)) {
+        index.points.push_back(SeekPoint{.pts = ts, .pos = packet->pos});
+      }
+    }
+    av_packet_unref(packet);
+  }
+  error = error == AVERROR_EOF ? 0 : error;
+
+cleanup:
+  av_packet_free(&packet);
+  avformat_close_input(&input_format_context);
+  return error;
+}
+
+std::shared_ptr<const SeekIndex> load_seek_index(const std::string &path,
+                                                 int stream_index) {
+  using IndexFuture = std::shared_future<std::shared_ptr<const SeekIndex>>;
+  struct CacheEntry {
+    std::uintmax_t size;
+    std::filesystem::file_time_type mtime;
+    /// ready once the build finished, callers arriving earlier wait on it
+    IndexFuture index;
+    /// tells a failed build which entry is its own
+    std::uint64_t build_id;
+  };
+  static std::mutex mutex;
+  static std::map<std::pair<std::string, int>, CacheEntry> cache;
+  static std::uint64_t next_build_id = 0;
+
+  std::error_code ec;
+  const std::uintmax_t size = std::filesystem::file_size(path, ec);
+  if (ec) {
+    return nullptr;
+  }
+  const auto mtime = std::filesystem::last_write_time(path, ec);
+  if (ec) {
+    return nullptr;
+  }
+
+  /* The first caller builds, e.g. the slices of a sliced decoder that all
+   * seek at once wait for its single scan instead of each running one. */
+  const auto key = std::make_pair(path, stream_index);
+  std::promise<std::shared_ptr<const SeekIndex>> promise;
+  IndexFuture cached;
+  std::uint64_t build_id = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = cache.find(key);
+    if (it != cache.end() && it->second.size == size &&
+        it->second.mtime == mtime) {
+      cached = it->second.index;
+    } else {
+      if (cache.size() >= kMaxIndexedFiles) {
+        cache.clear();
+      }
+      build_id = next_build_id++;
+      cache[key] = CacheEntry{.size = size,
+                              .mtime = mtime,
+                              .index = promise.get_future().share(),
+                              .build_id = build_id};
+    }
+  }
+  if (cached.valid()) {
+    return cached.get();
+  }
+
+  auto index = std::make_shared<SeekIndex>();
+  if (build_seek_index(path, stream_index, *index) < 0) {
+    index.reset();
+  }
+  promise.set_value(index);
+
+  /* Forget a failed build so a later seek tries again. */
+  if (!index) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = cache.find(key);
+    if (it != cache.end() && it->second.build_id == build_id) {
+      cache.erase(it);
+    }
+  }
+  return index;
+}
+
+} // namespace codec
+} // namespace spleeter
@@ -0,0 +1,41 @@
+#ifndef SPLEETER_FFMPEG_AUDIO_INDEX_H
+#define SPLEETER_FFMPEG_AUDIO_INDEX_H
+extern "C" {
+#include "libavformat/avformat.h"
+}
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace spleeter {
+namespace codec {
+
+/// Position of a key packet of the audio stream.
+struct SeekPoint {
+  /// presentation timestamp in stream time base
+  std::int64_t pts;
+  /// byte offset in the file, -1 if unknown
+  std::int64_t pos;
+};
+
+/// Sparse packet index of one audio stream, built once by demuxing the file
+/// without decoding it.
+struct SeekIndex {
+  int stream_index;
+  AVRational time_base;
+  std::vector<SeekPoint> points;
+};
+
+/// Returns the index of the given audio stream of path. The index is built on
+/// the first request and cached for the process; the cache entry is dropped
+/// when the size or modification time of the file changes. The cache is
+/// bounded like the stream probe cache and starts over when it is full.
+std::shared_ptr<const SeekIndex> load_seek_index(const std::string &path,
+                                                 int stream_index);
+
+} // namespace codec
+} // namespace spleeter
+
+#endif
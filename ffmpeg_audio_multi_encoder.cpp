@@ -0,0 +1,257 @@
+#include "ffmpeg_audio_multi_encoder.h"
+#include "ffmpeg_audio_common.h"
+#include <algorithm>
+#include <chrono>
+
+namespace spleeter {
+namespace codec {
+
+using Clock = std::chrono::steady_clock;
+
+static double seconds_since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/// Frames converted and queued at once, bounds the memory of a block and
+/// lets the outputs start on a long waveform before it is fully converted.
+static constexpr std::size_t kMaxBlockSize = 1 << 16;
+
+FFmpegMultiAudioEncoder::FFmpegMultiAudioEncoder(int src_sample_rate,
+                                                 AVSampleFormat src_sample_fmt,
+                                                 int nb_channels)
+    : src_sample_rate_(src_sample_rate), src_sample_fmt_(src_sample_fmt),
+      nb_channels_(nb_channels) {}
+
+void FFmpegMultiAudioEncoder::run(Output &output) {
+  AudioOutputStats &stats = output.stats;
+  std::shared_ptr<const Block> block;
+  int ret = 1;
+
+  while (true) {
+    auto start = Clock::now();
+    if (!output.blocks.pop(block)) {
+      break;
+    }
+    stats.wait_seconds += seconds_since(start);
+
+    start = Clock::now();
+    ret = output.encoder->encode(block->data.data(), block->nb_samples);
+    stats.busy_seconds += seconds_since(start);
+    if (ret <= 0) {
+      break;
+    }
+    stats.nb_frames += block->nb_samples;
+    block.reset();
+  }
+
+  /* Set before the queue was closed, so it is visible once pop failed. */
+  if (ret > 0 && output.finish && result_.load() > 0) {
+    const auto start = Clock::now();
+    ret = output.encoder->finish();
+    stats.busy_seconds += seconds_since(start);
+  }
+
+  stats.result = ret;
+  if (ret <= 0) {
+    int expected = 1;
+    result_.compare_exchange_strong(expected, ret);
+    output.blocks.close();
+  }
+}
+
+std::unique_ptr<FFmpegMultiAudioEncoder> FFmpegMultiAudioEncoder::create(
+    const std::vector<AudioOutput> &outputs, int src_sample_rate,
+    AVSampleFormat src_sample_fmt, const AVChannelLayout &src_ch_layout,
+    std::size_t depth, CancelToken *cancel_token,
+    std::shared_ptr<avpro::MediaPool> pool) {
+  if (outputs.empty() || !depth || av_sample_fmt_is_planar(src_sample_fmt)) {
+    fprintf(stderr, "Invalid multi output encoder parameters\n");
+    return nullptr;
+  }
+  if (!pool) {
+    pool = std::make_shared<avpro::MediaPool>();
+  }
+
+  auto encoder = std::make_unique<FFmpegMultiAudioEncoder>(
+      src_sample_rate, src_sample_fmt, src_ch_layout.nb_channels);
+
+  for (const AudioOutput &spec : outputs) {
+    const int sample_rate =
+        spec.sample_rate > 0 ? spec.sample_rate : src_sample_rate;
+    AVSampleFormat sample_fmt =
+        FFmpegAudioEncoder::codec_sample_fmt(spec.path, src_sample_fmt);
+    if (sample_fmt == AV_SAMPLE_FMT_NONE) {
+      fprintf(stderr, "Could not find an encoder for '%s'\n",
+              spec.path.c_str());
+      return nullptr;
+    }
+    /* The encoder (de)interleaves by itself, groups only differ in sample
+     * type and rate. */
+    sample_fmt = av_get_packed_sample_fmt(sample_fmt);
+
+    auto &groups = encoder->groups_;
+    auto it = std::find_if(groups.begin(), groups.end(), [&](auto &group) {
+      return group->sample_rate == sample_rate &&
+             group->sample_fmt == sample_fmt;
+    });
+    if (it == groups.end()) {
+      auto group = std::make_unique<Group>();
+      group->sample_rate = sample_rate;
+      group->sample_fmt = sample_fmt;
+      group->convert =
+          sample_rate != src_sample_rate || sample_fmt != src_sample_fmt;
+      if (group->convert &&
+          init_converter(&src_ch_layout, src_sample_fmt, src_sample_rate,
+                         &src_ch_layout, sample_fmt, sample_rate,
+                         group->converter) < 0) {
+        return nullptr;
+      }
+      groups.push_back(std::move(group));
+      it = groups.end() - 1;
+    }
+
+    auto output = std::make_unique<Output>(depth);
+    output->group = it - groups.begin();
+    output->stats.path = spec.path;
+    if (!(output->encoder = FFmpegAudioEncoder::create(
+              spec.path, sample_rate, sample_fmt, src_ch_layout, spec.bitrate,
+              cancel_token, pool))) {
+      return nullptr;
+    }
+    encoder->outputs_.push_back(std::move(output));
+  }
+
+  for (auto &output : encoder->outputs_) {
+    output->thread = std::thread(&FFmpegMultiAudioEncoder::run, encoder.get(),
+                                 std::ref(*output));
+  }
+  return encoder;
+}
+
+int FFmpegMultiAudioEncoder::queue(std::size_t group,
+                                   std::shared_ptr<const Block> block) {
+  for (auto &output : outputs_) {
+    if (output->group == group && !output->blocks.push(block)) {
+      /* Closed by a failed output, or finish was already called. */
+      const int ret = result_.load();
+      return ret <= 0 ? ret : AVERROR_EXIT;
+    }
+  }
+  return 1;
+}
+
+int FFmpegMultiAudioEncoder::convert_and_queue(Group &group,
+                                               std::size_t index,
+                                               const uint8_t *data,
+                                               int nb_samples) {
+  const auto start = Clock::now();
+  auto block = std::make_shared<Block>();
+  const std::size_t bytes_per_frame =
+      av_get_bytes_per_sample(group.sample_fmt) * nb_channels_;
+
+  if (!group.convert) {
+    block->data.assign(data, data + nb_samples * bytes_per_frame);
+    block->nb_samples = nb_samples;
+  } else {
+    int ret = group.converter.get_out_samples(nb_samples);
+    if (ret < 0) {
+      return ret;
+    }
+    block->data.resize(ret * bytes_per_frame);
+    uint8_t *output_data[1] = {block->data.data()};
+    const uint8_t *input_data[1] = {data};
+    if ((ret = group.converter.convert(output_data, ret,
+                                       data ? input_data : NULL,
+                                       nb_samples)) < 0) {
+      fprintf(stderr, "Could not convert input samples (error '%s')\n",
+              av_err2str(ret));
+      return ret;
+    }
+    block->nb_samples = ret;
+    block->data.resize(ret * bytes_per_frame);
+  }
+  group.convert_seconds += seconds_since(start);
+
+  if (!block->nb_samples) {
+    return 1;
+  }
+  return queue(index, std::move(block));
+}
+
+int FFmpegMultiAudioEncoder::encode(const WaveformView &waveform) {
+  int ret = result_.load();
+  if (ret <= 0) {
+    return ret;
+  }
+
+  /* The converters and the blocks take packed samples. */
+  Waveform copy;
+  const float *data = waveform.data;
+  if (!waveform.contiguous()) {
+    copy = waveform.to_waveform();
+    data = copy.data.data();
+  }
+
+  for (std::size_t i = 0; i < waveform.nb_frames; i += kMaxBlockSize) {
+    const int n = static_cast<int>(
+        std::min(kMaxBlockSize, waveform.nb_frames - i));
+    const auto *block_data =
+        reinterpret_cast<const uint8_t *>(data + i * nb_channels_);
+    for (std::size_t g = 0; g < groups_.size(); ++g) {
+      if ((ret = convert_and_queue(*groups_[g], g, block_data, n)) <= 0) {
+        return ret;
+      }
+    }
+  }
+  return 1;
+}
+
+int FFmpegMultiAudioEncoder::finish() {
+  int ret = result_.load();
+
+  /* Drain the resampler delay of every converting group. */
+  for (std::size_t g = 0; ret > 0 && g < groups_.size(); ++g) {
+    Group &group = *groups_[g];
+    if (group.convert &&
+        group.converter.mode() == SampleConverter::Mode::kResample) {
+      ret = convert_and_queue(group, g, NULL, 0);
+    }
+  }
+
+  for (auto &output : outputs_) {
+    output->finish = ret > 0;
+  }
+  stop();
+
+  if (ret <= 0) {
+    int expected = 1;
+    result_.compare_exchange_strong(expected, ret);
+  }
+  return result_.load();
+}
+
+std::vector<AudioOutputStats> FFmpegMultiAudioEncoder::stats() const {
+  std::vector<AudioOutputStats> stats;
+
+  for (auto &output : outputs_) {
+    stats.push_back(output->stats);
+    stats.back().convert_seconds = groups_[output->group]->convert_seconds;
+  }
+  return stats;
+}
+
+void FFmpegMultiAudioEncoder::stop() {
+  for (auto &output : outputs_) {
+    output->blocks.close();
+  }
+  for (auto &output : outputs_) {
+    if (output->thread.joinable()) {
+      output->thread.join();
+    }
+  }
+}
+
+FFmpegMultiAudioEncoder::~FFmpegMultiAudioEncoder() { stop(); }
+
+} // namespace codec
+} // namespace spleeter
@@ -0,0 +1,105 @@
+#ifndef SPLEETER_FFMPEG_AUDIO_MULTI_ENCODER_H
+#define SPLEETER_FFMPEG_AUDIO_MULTI_ENCODER_H
+
+#include "blocking_queue.h"
+#include "common.h"
+#include "ffmpeg_audio_codec.h"
+#include "ffmpeg_audio_encoder.h"
+#include "sample_converter.h"
+#include "waveform.h"
+#include <atomic>
+#include <memory>
+#include <memory_resource>
+#include <thread>
+#include <vector>
+
+namespace spleeter {
+namespace codec {
+
+/// Encodes one sample stream into several outputs at once, e.g. a bitrate
+/// ladder. Outputs whose encoders take the same packed sample format at the
+/// same rate form a group; every group converts the input once and shares
+/// the converted samples with its outputs. Each output encodes and muxes on
+/// its own thread.
+class FFmpegMultiAudioEncoder {
+  /// Converted samples of one encode call, read by all outputs of a group.
+  struct Block {
+    std::pmr::vector<uint8_t> data{sample_memory()};
+    int nb_samples{0};
+  };
+
+  struct Group {
+    int sample_rate;
+    /// packed format of the group's samples
+    AVSampleFormat sample_fmt;
+    /// false if the source samples already have the group's shape
+    bool convert{false};
+    SampleConverter converter;
+    double convert_seconds{0};
+  };
+
+  struct Output {
+    std::unique_ptr<FFmpegAudioEncoder> encoder;
+    std::size_t group;
+    BlockingQueue<std::shared_ptr<const Block>> blocks;
+    /// set before the queue is closed to flush the encoder at the end
+    bool finish{false};
+    AudioOutputStats stats;
+    std::thread thread;
+
+    explicit Output(std::size_t depth) : blocks(depth) {}
+  };
+
+  int src_sample_rate_;
+  AVSampleFormat src_sample_fmt_;
+  int nb_channels_;
+  std::vector<std::unique_ptr<Group>> groups_;
+  std::vector<std::unique_ptr<Output>> outputs_;
+  /// first failure or cancellation of an output, 1 while all are fine
+  std::atomic<int> result_{1};
+
+  void run(Output &output);
+
+  int convert_and_queue(Group &group, std::size_t index, const uint8_t *data,
+                        int nb_samples);
+
+  int queue(std::size_t group, std::shared_ptr<const Block> block);
+
+  void stop();
+
+public:
+  FFmpegMultiAudioEncoder(int src_sample_rate, AVSampleFormat src_sample_fmt,
+                          int nb_channels);
+
+  FFmpegMultiAudioEncoder(const FFmpegMultiAudioEncoder &) = delete;
+
+  FFmpegMultiAudioEncoder &
+  operator=(const FFmpegMultiAudioEncoder &) = delete;
+
+  /// The source must be packed. depth bounds the blocks waiting per output.
+  static std::unique_ptr<FFmpegMultiAudioEncoder>
+  create(const std::vector<AudioOutput> &outputs, int src_sample_rate,
+         AVSampleFormat src_sample_fmt, const AVChannelLayout &src_ch_layout,
+         std::size_t depth, CancelToken *cancel_token,
+         std::shared_ptr<avpro::MediaPool> pool = nullptr);
+
+  /// Converts the samples once per group and queues them for its outputs.
+  /// Returns 1 once queued, or the result of an earlier failed or canceled
+  /// output.
+  int encode(const WaveformView &waveform);
+
+  /// Waits for all outputs to encode their samples, flush and write the
+  /// trailer. Returns the first failure, 1 if every output succeeded.
+  int finish();
+
+  /// Per output, in the order given to create. Complete after finish.
+  std::vector<AudioOutputStats> stats() const;
+
+  std::size_t nb_groups() const { return groups_.size(); }
+
+  ~FFmpegMultiAudioEncoder();
+};
+} // namespace codec
+} // namespace spleeter
+
+#endif
@@ -0,0 +1,378 @@
+#include "ffmpeg_audio_parallel_encoder.h"
+#include "ffmpeg_audio_common.h"
+#include <algorithm>
+
+extern "C" {
+#include "libavutil/opt.h"
+}
+
+namespace spleeter {
+namespace codec {
+
+/// Codec frames encoded before and after the range of a chunk. They cover
+/// the encoder delay and let psychoacoustics and rate control settle; their
+/// packets are dropped.
+static constexpr std::int64_t kPrerollFrames = 8;
+
+FFmpegParallelAudioEncoder::ChunkPackets::~ChunkPackets() {
+  for (AVPacket *packet : packets) {
+    av_packet_free(&packet);
+  }
+}
+
+FFmpegParallelAudioEncoder::FFmpegParallelAudioEncoder(
+    int src_sample_rate, AVSampleFormat src_sample_fmt,
+    const AVChannelLayout &src_ch_layout, int nb_threads,
+    CancelToken *cancel_token, std::shared_ptr<avpro::MediaPool> pool)
+    : src_sample_rate_(src_sample_rate), src_sample_fmt_(src_sample_fmt),
+      cancel_token_(cancel_token),
+      pool_(pool ? std::move(pool) : std::make_shared<avpro::MediaPool>()),
+      input_(src_ch_layout.nb_channels), jobs_(nb_threads),
+      done_(2 * nb_threads) {
+  av_channel_layout_copy(&src_ch_layout_, &src_ch_layout);
+}
+
+bool FFmpegParallelAudioEncoder::supports(const std::string &path,
+                                          const std::string &format) {
+  const AVOutputFormat *oformat = av_guess_format(
+      format.empty() ? NULL : format.c_str(), path.c_str(), NULL);
+  return oformat && (oformat->audio_codec == AV_CODEC_ID_AAC ||
+                     oformat->audio_codec == AV_CODEC_ID_MP3);
+}
+
+std::unique_ptr<FFmpegParallelAudioEncoder>
+FFmpegParallelAudioEncoder::create(std::string path, int src_sample_rate,
+                                   AVSampleFormat src_sample_fmt,
+                                   const AVChannelLayout &src_ch_layout,
+                                   int bitrate, int nb_threads,
+                                   std::size_t chunk_frames,
+                                   CancelToken *cancel_token,
+                                   std::shared_ptr<avpro::MediaPool> pool,
+                                   const avpro::OutputSink *sink) {
+  if (nb_threads < 1 || av_sample_fmt_is_planar(src_sample_fmt)) {
+    fprintf(stderr, "Invalid parallel encoder parameters\n");
+    return nullptr;
+  }
+
+  auto encoder = std::make_unique<FFmpegParallelAudioEncoder>(
+      src_sample_rate, src_sample_fmt, src_ch_layout, nb_threads,
+      cancel_token, std::move(pool));
+  if ((open_output_file(path.c_str(), src_sample_rate, src_sample_fmt,
+                        src_ch_layout.nb_channels, bitrate,
+                        &encoder->output_format_context_,
+                        &encoder->output_codec_context_, sink)))
+    return nullptr;
+
+  /* Chunks start on the frame grid of a serial encode. */
+  const std::int64_t frame_size =
+      get_output_frame_size(encoder->output_codec_context_);
+  const std::int64_t nb_frames =
+      (std::max<std::int64_t>(chunk_frames, 1) + frame_size - 1) / frame_size;
+  encoder->preroll_frames_ = kPrerollFrames * frame_size;
+  encoder->chunk_frames_ =
+      std::max(nb_frames * frame_size, encoder->preroll_frames_);
+
+  if ((write_output_file_header(encoder->output_format_context_)))
+    return nullptr;
+
+  for (int i = 0; i < nb_threads; ++i) {
+    encoder->workers_.emplace_back(&FFmpegParallelAudioEncoder::work,
+                                   encoder.get());
+  }
+  encoder->mux_thread_ =
+      std::thread(&FFmpegParallelAudioEncoder::mux, encoder.get());
+  return encoder;
+}
+
+int FFmpegParallelAudioEncoder::encode_chunk(const Job &job,
+                                             ChunkPackets &chunk) {
+  const AVCodecContext *params = output_codec_context_;
+  const int frame_size = get_output_frame_size(params);
+  const std::size_t input_bytes_per_frame =
+      av_get_bytes_per_sample(src_sample_fmt_) * src_ch_layout_.nb_channels;
+  AVCodecContext *avctx = NULL;
+  AVFrame *frame = NULL;
+  AVPacket *packet = NULL;
+  SampleConverter converter;
+  std::vector<uint8_t *> output_data;
+  std::size_t output_bytes_per_frame;
+  std::int64_t pts = job.input_start;
+  std::int64_t delay = 0;
+  int fill = 0;
+  int error;
+
+  /* Sends frame (NULL flushes) and keeps the packets inside the chunk. The
+   * boundaries are shifted by the encoder delay like the packet pts. */
+  auto send = [&](AVFrame *input) {
+    if (input) {
+      input->pts = pts;
+      pts += input->nb_samples;
+    }
+    int ret = avcodec_send_frame(avctx, input);
+    if (ret < 0) {
+      return ret;
+    }
+    while ((ret = avcodec_receive_packet(avctx, packet)) >= 0) {
+      if ((job.first || packet->pts >= job.start - delay) &&
+          (job.last || packet->pts < job.end - delay)) {
+        AVPacket *kept = av_packet_alloc();
+        if (!kept) {
+          return AVERROR(ENOMEM);
+        }
+        av_packet_move_ref(kept, packet);
+        chunk.packets.push_back(kept);
+      } else {
+        av_packet_unref(packet);
+      }
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+  };
+
+  if (!(avctx = avcodec_alloc_context3(params->codec))) {
+    error = AVERROR(ENOMEM);
+    goto cleanup;
+  }
+  if ((error = av_channel_layout_copy(&avctx->ch_layout, &params->ch_layout)) <
+      0)
+    goto cleanup;
+  avctx->sample_rate = params->sample_rate;
+  avctx->sample_fmt = params->sample_fmt;
+  avctx->bit_rate = params->bit_rate;
+  avctx->flags = params->flags;
+  /* A bit reservoir lets a frame borrow bits of the previous ones, the
+   * chunks' packets must stand alone. Codecs without one ignore it. */
+  av_opt_set_int(avctx, "reservoir", 0, AV_OPT_SEARCH_CHILDREN);
+  if ((error = avcodec_open2(avctx, params->codec, NULL)) < 0) {
+    fprintf(stderr, "Could not open output codec (error '%s')\n",
+            av_err2str(error));
+    goto cleanup;
+  }
+  delay = avctx->initial_padding;
+
+  /* Only the sample format changes, so the converter never buffers. */
+  if ((error = init_converter(&src_ch_layout_, src_sample_fmt_,
+                              src_sample_rate_, &avctx->ch_layout,
+                              avctx->sample_fmt, avctx->sample_rate,
+                              converter)) < 0)
+    goto cleanup;
+  if (!(frame = pool_->acquire_audio_frame(&avctx->ch_layout,
+                                           avctx->sample_fmt,
+                                           avctx->sample_rate, frame_size)) ||
+      !(packet = pool_->acquire_packet())) {
+    error = AVERROR(ENOMEM);
+    goto cleanup;
+  }
+  output_data.resize(av_sample_fmt_is_planar(avctx->sample_fmt)
+                         ? avctx->ch_layout.nb_channels
+                         : 1);
+  output_bytes_per_frame =
+      av_get_bytes_per_sample(avctx->sample_fmt) *
+      (output_data.size() == 1 ? avctx->ch_layout.nb_channels : 1);
+
+  error = job.input.for_each_chunk([&](const WaveformView &view) {
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(view.data);
+    std::size_t remaining = view.nb_frames;
+    int ret;
+
+    while (remaining > 0) {
+      if (cancel_token_->is_cancelled()) {
+        return 0;
+      }
+      if (fill == 0) {
+        frame->nb_samples = frame_size;
+        if ((ret = av_frame_make_writable(frame)) < 0)
+          return ret;
+      }
+      const int n = static_cast<int>(
+          std::min<std::size_t>(frame_size - fill, remaining));
+      for (std::size_t i = 0; i < output_data.size(); ++i) {
+        output_data[i] =
+            frame->extended_data[i] + fill * output_bytes_per_frame;
+      }
+      const uint8_t *input_data[1] = {data};
+      if ((ret = converter.convert(output_data.data(), n, input_data, n)) < 0)
+        return ret;
+      fill += n;
+      data += n * input_bytes_per_frame;
+      remaining -= n;
+      if (fill == frame_size) {
+        fill = 0;
+        if ((ret = send(frame)) < 0)
+          return ret;
+      }
+    }
+    return 1;
+  });
+  if (error <= 0)
+    goto cleanup;
+
+  /* Only the last chunk ends off the frame grid. */
+  if (fill > 0) {
+    frame->nb_samples = fill;
+    if ((error = send(frame)) < 0)
+      goto cleanup;
+  }
+  if ((error = send(NULL)) < 0)
+    goto cleanup;
+  error = 1;
+
+cleanup:
+  pool_->release_packet(packet);
+  pool_->release_frame(frame);
+  avcodec_free_context(&avctx);
+  if (error < 0) {
+    fprintf(stderr, "Could not encode chunk %zu (error '%s')\n", job.index,
+            av_err2str(error));
+  }
+  return error;
+}
+
+void FFmpegParallelAudioEncoder::work() {
+  std::unique_ptr<Job> job;
+
+  while (jobs_.pop(job)) {
+    auto chunk = std::make_unique<ChunkPackets>();
+    chunk->end = job->end;
+    chunk->result = encode_chunk(*job, *chunk);
+    const std::size_t index = job->index;
+    /* Drop the input before waiting for the muxer. */
+    job.reset();
+    if (!done_.push(index, std::move(chunk))) {
+      break;
+    }
+  }
+}
+
+void FFmpegParallelAudioEncoder::mux() {
+  std::unique_ptr<ChunkPackets> chunk;
+  int error;
+
+  while (done_.pop(chunk)) {
+    if (chunk->result <= 0) {
+      fail(chunk->result);
+      return;
+    }
+    for (AVPacket *packet : chunk->packets) {
+      packet->stream_index = 0;
+      if ((error = av_write_frame(output_format_context_, packet)) < 0) {
+        fprintf(stderr, "Could not write frame (error '%s')\n",
+                av_err2str(error));
+        fail(error);
+        return;
+      }
+    }
+    last_timestamp_ = av_rescale(chunk->end, 1000, src_sample_rate_);
+  }
+}
+
+void FFmpegParallelAudioEncoder::fail(int error) {
+  int expected = 1;
+  result_.compare_exchange_strong(expected, error);
+  jobs_.close();
+  done_.close();
+}
+
+int FFmpegParallelAudioEncoder::dispatch(bool last) {
+  const std::int64_t start = next_start_;
+  const std::int64_t end = last ? input_end_ : start + chunk_frames_;
+  const std::int64_t input_start =
+      std::max<std::int64_t>(0, start - preroll_frames_);
+  const std::int64_t input_end = last ? input_end_ : end + preroll_frames_;
+  auto job = std::make_unique<Job>(
+      Job{.index = next_index_++,
+          .start = start,
+          .end = end,
+          .first = start == 0,
+          .last = last,
+          .input_start = input_start,
+          .input = input_.sub_frames(input_start - input_start_,
+                                     input_end - input_start_)});
+
+  /* Keep the pre-roll of the next chunk. */
+  next_start_ = end;
+  const std::int64_t keep_from =
+      std::max<std::int64_t>(0, next_start_ - preroll_frames_);
+  input_.pop_front_frames(keep_from - input_start_);
+  input_start_ = keep_from;
+
+  if (!jobs_.push(std::move(job))) {
+    const int ret = result_.load();
+    return ret <= 0 ? ret : AVERROR_EXIT;
+  }
+  return 1;
+}
+
+int FFmpegParallelAudioEncoder::dispatch_ready() {
+  int ret = 1;
+
+  /* A chunk starts once the frames after it are there as well. */
+  while (ret > 0 &&
+         input_end_ - next_start_ >= chunk_frames_ + preroll_frames_) {
+    ret = dispatch(false);
+  }
+  return ret;
+}
+
+int FFmpegParallelAudioEncoder::encode(Waveform &&waveform) {
+  const int ret = result_.load();
+  if (ret <= 0) {
+    return ret;
+  }
+  if (finished_) {
+    return AVERROR_EXIT;
+  }
+  input_end_ += waveform.nb_frames;
+  input_.append(std::move(waveform));
+  return dispatch_ready();
+}
+
+int FFmpegParallelAudioEncoder::encode(const WaveformView &waveform) {
+  return encode(waveform.to_waveform());
+}
+
+int FFmpegParallelAudioEncoder::finish() {
+  if (finished_) {
+    return AVERROR_EXIT;
+  }
+  finished_ = true;
+
+  /* The last chunk also carries the encoder's tail, even when it is empty. */
+  if (result_.load() > 0) {
+    dispatch(true);
+  }
+  stop();
+
+  int ret = result_.load();
+  if (ret <= 0) {
+    return ret;
+  }
+  if ((ret = write_output_file_trailer(output_format_context_)) < 0) {
+    return ret;
+  }
+  return 1;
+}
+
+void FFmpegParallelAudioEncoder::stop() {
+  jobs_.close();
+  for (auto &worker : workers_) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+  /* Every chunk is in, the muxer drains them and stops. */
+  done_.close();
+  if (mux_thread_.joinable()) {
+    mux_thread_.join();
+  }
+}
+
+FFmpegParallelAudioEncoder::~FFmpegParallelAudioEncoder() {
+  stop();
+  if (output_codec_context_)
+    avcodec_free_context(&output_codec_context_);
+  close_output_file(&output_format_context_);
+  av_channel_layout_uninit(&src_ch_layout_);
+}
+
+} // namespace codec
+} // namespace spleeter
@@ -0,0 +1,131 @@
+#ifndef SPLEETER_FFMPEG_AUDIO_PARALLEL_ENCODER_H
+#define SPLEETER_FFMPEG_AUDIO_PARALLEL_ENCODER_H
+
+#include "blocking_queue.h"
+#include "common.h"
+#include "ffmpeg_audio_encoder.h"
+#include "reorder_buffer.h"
+#include "waveform.h"
+#include "waveform_rope.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace spleeter {
+namespace codec {
+
+/// Encodes one stream on several threads. The input is cut into chunks on
+/// the codec frame grid and every chunk is encoded by its own codec context,
+/// starting a few frames early so the encoder state has settled by the
+/// chunk start and running a few frames past the end. The packets of each
+/// chunk's own range are muxed in order, so the result is one continuous
+/// stream with the timestamps of a serial encode.
+class FFmpegParallelAudioEncoder {
+  struct Job {
+    std::size_t index;
+    /// frames [start, end) of the stream this chunk contributes packets for
+    std::int64_t start;
+    std::int64_t end;
+    bool first;
+    bool last;
+    /// stream frame of the first input sample, start minus the pre-roll
+    std::int64_t input_start;
+    WaveformRope input;
+  };
+
+  struct ChunkPackets {
+    int result{1};
+    std::int64_t end{0};
+    std::vector<AVPacket *> packets;
+
+    ~ChunkPackets();
+  };
+
+  int src_sample_rate_;
+  AVSampleFormat src_sample_fmt_;
+  AVChannelLayout src_ch_layout_;
+  CancelToken *cancel_token_;
+  std::shared_ptr<avpro::MediaPool> pool_;
+  std::int64_t chunk_frames_;
+  std::int64_t preroll_frames_;
+
+  AVFormatContext *output_format_context_ = NULL;
+  /// holds the stream parameters every chunk context is opened with
+  AVCodecContext *output_codec_context_ = NULL;
+
+  /// received input not yet handed to a chunk, and the pre-roll before it
+  WaveformRope input_;
+  std::int64_t input_start_{0};
+  std::int64_t input_end_{0};
+  std::int64_t next_start_{0};
+  std::size_t next_index_{0};
+  bool finished_{false};
+
+  BlockingQueue<std::unique_ptr<Job>> jobs_;
+  ReorderBuffer<std::unique_ptr<ChunkPackets>> done_;
+  /// first failure or cancellation, 1 while fine
+  std::atomic<int> result_{1};
+  std::atomic<std::int64_t> last_timestamp_{0};
+  std::vector<std::thread> workers_;
+  std::thread mux_thread_;
+
+  void work();
+
+  void mux();
+
+  void fail(int error);
+
+  int encode_chunk(const Job &job, ChunkPackets &chunk);
+
+  int dispatch(bool last);
+
+  int dispatch_ready();
+
+  void stop();
+
+public:
+  FFmpegParallelAudioEncoder(int src_sample_rate,
+                             AVSampleFormat src_sample_fmt,
+                             const AVChannelLayout &src_ch_layout,
+                             int nb_threads, CancelToken *cancel_token,
+                             std::shared_ptr<avpro::MediaPool> pool);
+
+  FFmpegParallelAudioEncoder(const FFmpegParallelAudioEncoder &) = delete;
+
+  FFmpegParallelAudioEncoder &
+  operator=(const FFmpegParallelAudioEncoder &) = delete;
+
+  /// Whether the codec of the container named format, or guessed from path,
+  /// can be encoded in chunks. Codecs that rewrite their header at the end
+  /// (FLAC) cannot.
+  static bool supports(const std::string &path, const std::string &format = "");
+
+  /// chunk_frames is rounded up to whole codec frames. The source must be
+  /// packed, its rate is the output rate.
+  static std::unique_ptr<FFmpegParallelAudioEncoder>
+  create(std::string path, int src_sample_rate, AVSampleFormat src_sample_fmt,
+         const AVChannelLayout &src_ch_layout, int bitrate, int nb_threads,
+         std::size_t chunk_frames, CancelToken *cancel_token,
+         std::shared_ptr<avpro::MediaPool> pool = nullptr,
+         const avpro::OutputSink *sink = nullptr);
+
+  /// Buffers the samples and starts every chunk they complete. Returns 1, or
+  /// the result of an earlier failed or canceled chunk.
+  int encode(const WaveformView &waveform);
+
+  /// Same as above without a copy.
+  int encode(Waveform &&waveform);
+
+  /// Encodes the last chunk, waits for all of them and writes the trailer.
+  int finish();
+
+  /// Timestamp (milliseconds) of the end of the last muxed chunk.
+  std::int64_t last_timestamp() const { return last_timestamp_.load(); }
+
+  ~FFmpegParallelAudioEncoder();
+};
+} // namespace codec
+} // namespace spleeter
+
+#endif
@@ -0,0 +1,141 @@
+#include "ffmpeg_audio_prefetch_decoder.h"
+#include <algorithm>
+#include <cstring>
+
+namespace spleeter {
+namespace codec {
+
+FFmpegPrefetchAudioDecoder::FFmpegPrefetchAudioDecoder(
+    std::unique_ptr<FFmpegAudioDecoder> decoder, int nb_channels,
+    std::size_t chunk_frames, std::size_t depth)
+    : decoder_(std::move(decoder)), chunk_frames_(chunk_frames),
+      nb_channels_(nb_channels), ready_(depth) {}
+
+void FFmpegPrefetchAudioDecoder::run() {
+  int ret;
+
+  while (1) {
+    std::unique_ptr<Waveform> chunk;
+    if (!free_.try_pop(chunk)) {
+      chunk = std::make_unique<Waveform>();
+    }
+    ret = decoder_->decode_into(*chunk, chunk_frames_);
+    if (ret <= 0 || chunk->nb_frames == 0) {
+      break;
+    }
+    /* A short chunk is the last one. */
+    const bool last = chunk->nb_frames < chunk_frames_;
+    if (!ready_.push(std::move(chunk)) || last) {
+      break;
+    }
+  }
+
+  /* Published to the consumer by the queue's lock. */
+  result_ = ret;
+  ready_.close();
+}
+
+void FFmpegPrefetchAudioDecoder::recycle(std::unique_ptr<Waveform> chunk) {
+  /* Keep no more spare buffers than can be in flight. */
+  if (chunk && free_.size() <= ready_.size() + 1) {
+    free_.push(std::move(chunk));
+  }
+}
+
+std::unique_ptr<FFmpegPrefetchAudioDecoder> FFmpegPrefetchAudioDecoder::create(
+    std::string path, int dst_sample_rate, AVSampleFormat dst_sample_fmt,
+    const AVChannelLayout &dst_ch_layout, std::size_t chunk_frames,
+    std::size_t depth, CancelToken *cancel_token,
+    std::shared_ptr<avpro::MediaPool> pool, const avpro::InputSource *source,
+    bool fast_open) {
+  if (!chunk_frames || !depth) {
+    fprintf(stderr, "Invalid prefetch chunk size or depth\n");
+    return nullptr;
+  }
+
+  auto decoder =
+      FFmpegAudioDecoder::create(std::move(path), dst_sample_rate,
+                                 dst_sample_fmt, dst_ch_layout, cancel_token,
+                                 std::move(pool), source, fast_open);
+  if (!decoder) {
+    return nullptr;
+  }
+
+  auto prefetch = std::make_unique<FFmpegPrefetchAudioDecoder>(
+      std::move(decoder), dst_ch_layout.nb_channels, chunk_frames, depth);
+  prefetch->thread_ = std::thread(&FFmpegPrefetchAudioDecoder::run,
+                                  prefetch.get());
+  return prefetch;
+}
+
+int FFmpegPrefetchAudioDecoder::decode_into(Waveform &waveform,
+                                            std::size_t max_frame_size) {
+  std::size_t nb_frames = 0;
+
+  while (nb_frames < max_frame_size) {
+    if (!chunk_ || chunk_offset_ == chunk_->nb_frames) {
+      recycle(std::move(chunk_));
+      if (!ready_.pop(chunk_)) {
+        if (result_ <= 0) {
+          return result_;
+        }
+        break;
+      }
+      chunk_offset_ = 0;
+
+      /* Hand the whole chunk over when it is exactly what was asked for, or
+       * the short last one. Storage only moves between vectors of the same
+       * memory resource. */
+      if (nb_frames == 0 && chunk_->nb_frames <= max_frame_size &&
+          waveform.data.get_allocator() == chunk_->data.get_allocator() &&
+          (chunk_->nb_frames == max_frame_size ||
+           chunk_->nb_frames < chunk_frames_)) {
+        std::swap(waveform.data, chunk_->data);
+        waveform.nb_channels = nb_channels_;
+        waveform.nb_frames = chunk_->nb_frames;
+        chunk_offset_ = chunk_->nb_frames;
+        return 1;
+      }
+    }
+
+    if (nb_frames == 0) {
+      waveform.nb_channels = nb_channels_;
+      waveform.data.resize(max_frame_size * nb_channels_);
+    }
+    const std::size_t n = std::min(max_frame_size - nb_frames,
+                                   chunk_->nb_frames - chunk_offset_);
+    memcpy(waveform.data.data() + nb_frames * nb_channels_,
+           chunk_->data.data() + chunk_offset_ * nb_channels_,
+           n * nb_channels_ * sizeof(float));
+    nb_frames += n;
+    chunk_offset_ += n;
+  }
+
+  waveform.nb_channels = nb_channels_;
+  waveform.nb_frames = nb_frames;
+  waveform.data.resize(nb_frames * nb_channels_);
+  return 1;
+}
+
+int FFmpegPrefetchAudioDecoder::decode(std::unique_ptr<Waveform> &result,
+                                       std::size_t max_frame_size,
+                                       std::pmr::memory_resource *memory) {
+  auto waveform =
+      std::make_unique<Waveform>(Waveform::with_resource(nb_channels_, memory));
+
+  int ret = decode_into(*waveform, max_frame_size);
+  if (ret > 0 && waveform->nb_frames > 0) {
+    result = std::move(waveform);
+  }
+  return ret;
+}
+
+FFmpegPrefetchAudioDecoder::~FFmpegPrefetchAudioDecoder() {
+  ready_.close();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+} // namespace codec
+} // namespace spleeter
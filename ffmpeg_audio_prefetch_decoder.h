@@ -0,0 +1,73 @@
+#ifndef SPLEETER_FFMPEG_AUDIO_PREFETCH_DECODER_H
+#define SPLEETER_FFMPEG_AUDIO_PREFETCH_DECODER_H
+
+#include "blocking_queue.h"
+#include "common.h"
+#include "ffmpeg_audio_decoder.h"
+#include "waveform.h"
+#include <memory>
+#include <thread>
+
+namespace spleeter {
+namespace codec {
+
+/// Runs an FFmpegAudioDecoder on a background thread that demuxes, decodes
+/// and resamples chunk_frames frames at a time into a bounded queue, so the
+/// consumer only waits when it outruns the decoder.
+class FFmpegPrefetchAudioDecoder {
+  std::unique_ptr<FFmpegAudioDecoder> decoder_;
+  std::size_t chunk_frames_;
+  int nb_channels_;
+
+  BlockingQueue<std::unique_ptr<Waveform>> ready_;
+  /// consumed chunks handed back to the decode thread with their storage
+  BlockingQueue<std::unique_ptr<Waveform>> free_;
+  /// decode result, written before ready_ is closed
+  int result_{1};
+  std::thread thread_;
+
+  std::unique_ptr<Waveform> chunk_;
+  std::size_t chunk_offset_{0};
+
+  void run();
+
+  void recycle(std::unique_ptr<Waveform> chunk);
+
+public:
+  FFmpegPrefetchAudioDecoder(std::unique_ptr<FFmpegAudioDecoder> decoder,
+                             int nb_channels, std::size_t chunk_frames,
+                             std::size_t depth);
+
+  FFmpegPrefetchAudioDecoder(const FFmpegPrefetchAudioDecoder &) = delete;
+
+  FFmpegPrefetchAudioDecoder &
+  operator=(const FFmpegPrefetchAudioDecoder &) = delete;
+
+  /// depth is the number of decoded chunks kept ready ahead of the consumer.
+  static std::unique_ptr<FFmpegPrefetchAudioDecoder>
+  create(std::string path, int dst_sample_rate, AVSampleFormat dst_sample_fmt,
+         const AVChannelLayout &dst_ch_layout, std::size_t chunk_frames,
+         std::size_t depth, CancelToken *cancel_token,
+         std::shared_ptr<avpro::MediaPool> pool = nullptr,
+         const avpro::InputSource *source = nullptr, bool fast_open = false);
+
+  int decode(std::unique_ptr<Waveform> &result, std::size_t max_frame_size,
+             std::pmr::memory_resource *memory = sample_memory());
+
+  /// Same contract as FFmpegAudioDecoder::decode_into. When max_frame_size
+  /// equals chunk_frames the chunk storage is swapped into waveform instead of
+  /// copied, and the previous storage of waveform goes back to the decoder.
+  int decode_into(Waveform &waveform, std::size_t max_frame_size);
+
+  /// Chunks currently decoded and waiting.
+  std::size_t buffered() const { return ready_.size(); }
+
+  /// Counted by the decode thread, so it runs ahead of what was consumed.
+  avpro::DemuxStats demux_stats() const { return decoder_->demux_stats(); }
+
+  ~FFmpegPrefetchAudioDecoder();
+};
+} // namespace codec
+} // namespace spleeter
+
+#endif
@@ -0,0 +1,174 @@
+#include "ffmpeg_audio_sliced_decoder.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+namespace spleeter {
+namespace codec {
+
+/// Slices shorter than this are not worth their own demuxer and decoder.
+static constexpr std::int64_t kMinSliceMs = 30 * 1000;
+
+FFmpegSlicedAudioDecoder::FFmpegSlicedAudioDecoder(int nb_channels)
+    : nb_channels_(nb_channels) {}
+
+void FFmpegSlicedAudioDecoder::decode_slice(Slice &slice,
+                                            std::size_t chunk_frames) {
+  int ret = 1;
+  std::int64_t remaining = slice.nb_frames;
+
+  /* The seek pre-rolls the decoder, so the first sample of the slice follows
+   * the last sample of the previous one exactly. */
+  if (slice.start > 0) {
+    ret = slice.decoder->seek_frame(slice.start);
+  }
+  while (ret > 0 && remaining != 0) {
+    std::size_t nb_frames =
+        remaining < 0 ? chunk_frames
+                      : std::min<std::size_t>(chunk_frames, remaining);
+    auto chunk = std::make_unique<Waveform>();
+    ret = slice.decoder->decode_into(*chunk, nb_frames);
+    if (ret <= 0 || chunk->nb_frames == 0) {
+      break;
+    }
+    if (remaining > 0) {
+      remaining -= chunk->nb_frames;
+    }
+    if (!slice.chunks.push(std::move(chunk))) {
+      break;
+    }
+  }
+
+  /* Published to the consumer by the queue's lock. */
+  slice.result = ret;
+  slice.chunks.close();
+}
+
+std::unique_ptr<FFmpegSlicedAudioDecoder> FFmpegSlicedAudioDecoder::create(
+    std::string path, int dst_sample_rate, AVSampleFormat dst_sample_fmt,
+    const AVChannelLayout &dst_ch_layout, int nb_slices,
+    std::size_t chunk_frames, std::size_t max_buffered_chunks,
+    CancelToken *cancel_token, std::shared_ptr<avpro::MediaPool> pool,
+    const avpro::InputSource *source, bool fast_open) {
+  auto decoder =
+      std::make_unique<FFmpegSlicedAudioDecoder>(dst_ch_layout.nb_channels);
+
+  auto first = FFmpegAudioDecoder::create(path, dst_sample_rate,
+                                          dst_sample_fmt, dst_ch_layout,
+                                          cancel_token, pool, source,
+                                          fast_open);
+  if (!first) {
+    return nullptr;
+  }
+
+  /* Without a known duration the file cannot be split. */
+  const std::int64_t duration = first->duration();
+  if (duration <= 0) {
+    nb_slices = 1;
+  } else {
+    nb_slices = static_cast<int>(std::max<std::int64_t>(
+        1, std::min<std::int64_t>(nb_slices, duration / kMinSliceMs)));
+  }
+  const std::int64_t total_frames =
+      av_rescale(std::max<std::int64_t>(duration, 0), dst_sample_rate, 1000);
+
+  /* The probe of the first slice is cached for the path, the other slices
+   * open in fast mode and skip theirs. */
+  for (int i = 0; i < nb_slices; ++i) {
+    auto slice = std::make_unique<Slice>(max_buffered_chunks);
+    if (i == 0) {
+      slice->decoder = std::move(first);
+    } else if (!(slice->decoder = FFmpegAudioDecoder::create(
+                     path, dst_sample_rate, dst_sample_fmt, dst_ch_layout,
+                     cancel_token, pool, source, fast_open || !source))) {
+      return nullptr;
+    }
+    slice->start = total_frames * i / nb_slices;
+    /* The last slice runs to the real end, the duration is an estimate. */
+    slice->nb_frames = i + 1 == nb_slices
+                           ? -1
+                           : total_frames * (i + 1) / nb_slices - slice->start;
+    decoder->slices_.push_back(std::move(slice));
+  }
+
+  for (auto &slice : decoder->slices_) {
+    slice->thread = std::thread(decode_slice, std::ref(*slice), chunk_frames);
+  }
+  return decoder;
+}
+
+int FFmpegSlicedAudioDecoder::decode_into(Waveform &waveform,
+                                          std::size_t max_frame_size) {
+  std::size_t nb_frames = 0;
+
+  waveform.nb_channels = nb_channels_;
+  waveform.data.resize(max_frame_size * nb_channels_);
+
+  while (nb_frames < max_frame_size) {
+    if (!chunk_ || chunk_offset_ == chunk_->nb_frames) {
+      if (current_slice_ == slices_.size()) {
+        break;
+      }
+      Slice &slice = *slices_[current_slice_];
+      if (!slice.chunks.pop(chunk_)) {
+        /* The slice is done, stop at the first failed or canceled one. */
+        chunk_.reset();
+        if (slice.result <= 0) {
+          return slice.result;
+        }
+        ++current_slice_;
+        continue;
+      }
+      chunk_offset_ = 0;
+    }
+
+    const std::size_t n = std::min(max_frame_size - nb_frames,
+                                   chunk_->nb_frames - chunk_offset_);
+    memcpy(waveform.data.data() + nb_frames * nb_channels_,
+           chunk_->data.data() + chunk_offset_ * nb_channels_,
+           n * nb_channels_ * sizeof(float));
+    nb_frames += n;
+    chunk_offset_ += n;
+  }
+
+  waveform.nb_frames = nb_frames;
+  waveform.data.resize(nb_frames * nb_channels_);
+  return 1;
+}
+
+int FFmpegSlicedAudioDecoder::decode(std::unique_ptr<Waveform> &result,
+                                     std::size_t max_frame_size,
+                                     std::pmr::memory_resource *memory) {
+  auto waveform =
+      std::make_unique<Waveform>(Waveform::with_resource(nb_channels_, memory));
+
+  int ret = decode_into(*waveform, max_frame_size);
+  if (ret > 0 && waveform->nb_frames > 0) {
+    result = std::move(waveform);
+  }
+  return ret;
+}
+
+avpro::DemuxStats FFmpegSlicedAudioDecoder::demux_stats() const {
+  avpro::DemuxStats stats;
+  for (const auto &slice : slices_) {
+    const avpro::DemuxStats slice_stats = slice->decoder->demux_stats();
+    stats.bytes_read += slice_stats.bytes_read;
+    stats.bytes_used += slice_stats.bytes_used;
+  }
+  return stats;
+}
+
+FFmpegSlicedAudioDecoder::~FFmpegSlicedAudioDecoder() {
+  for (auto &slice : slices_) {
+    slice->chunks.close();
+  }
+  for (auto &slice : slices_) {
+    if (slice->thread.joinable()) {
+      slice->thread.join();
+    }
+  }
+}
+
+} // namespace codec
+} // namespace spleeter
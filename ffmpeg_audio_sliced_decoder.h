@@ -0,0 +1,76 @@
+#ifndef SPLEETER_FFMPEG_AUDIO_SLICED_DECODER_H
+#define SPLEETER_FFMPEG_AUDIO_SLICED_DECODER_H
+
+#include "blocking_queue.h"
+#include "common.h"
+#include "ffmpeg_audio_decoder.h"
+#include "waveform.h"
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace spleeter {
+namespace codec {
+
+/// Decodes one file as nb_slices time ranges in parallel, every range with
+/// its own demuxer and decoder, and hands the samples out in file order
+/// through the same interface as FFmpegAudioDecoder.
+class FFmpegSlicedAudioDecoder {
+  struct Slice {
+    std::unique_ptr<FFmpegAudioDecoder> decoder;
+    /// first frame of the slice at the output rate
+    std::int64_t start{0};
+    /// frames in the slice, -1 for "until end of input"
+    std::int64_t nb_frames{-1};
+    BlockingQueue<std::unique_ptr<Waveform>> chunks;
+    int result{1};
+    std::thread thread;
+
+    explicit Slice(std::size_t max_buffered_chunks)
+        : chunks(max_buffered_chunks) {}
+  };
+
+  int nb_channels_;
+  std::vector<std::unique_ptr<Slice>> slices_;
+  std::size_t current_slice_{0};
+  std::unique_ptr<Waveform> chunk_;
+  std::size_t chunk_offset_{0};
+
+  static void decode_slice(Slice &slice, std::size_t chunk_frames);
+
+public:
+  explicit FFmpegSlicedAudioDecoder(int nb_channels);
+
+  FFmpegSlicedAudioDecoder(const FFmpegSlicedAudioDecoder &) = delete;
+
+  FFmpegSlicedAudioDecoder &
+  operator=(const FFmpegSlicedAudioDecoder &) = delete;
+
+  /// max_buffered_chunks bounds the decoded chunks waiting per slice, 0 lets
+  /// every slice run ahead to its end. With a source every slice opens its
+  /// own demuxer on it. The slices after the first one reuse its stream probe
+  /// of a path.
+  static std::unique_ptr<FFmpegSlicedAudioDecoder>
+  create(std::string path, int dst_sample_rate, AVSampleFormat dst_sample_fmt,
+         const AVChannelLayout &dst_ch_layout, int nb_slices,
+         std::size_t chunk_frames, std::size_t max_buffered_chunks,
+         CancelToken *cancel_token,
+         std::shared_ptr<avpro::MediaPool> pool = nullptr,
+         const avpro::InputSource *source = nullptr, bool fast_open = false);
+
+  int decode(std::unique_ptr<Waveform> &result, std::size_t max_frame_size,
+             std::pmr::memory_resource *memory = sample_memory());
+
+  int decode_into(Waveform &waveform, std::size_t max_frame_size);
+
+  std::size_t nb_slices() const { return slices_.size(); }
+
+  /// Sum over the slices, every slice reads its own part of the input.
+  avpro::DemuxStats demux_stats() const;
+
+  ~FFmpegSlicedAudioDecoder();
+};
+} // namespace codec
+} // namespace spleeter
+
+#endif
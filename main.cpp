@@ -1,5 +1,6 @@
 #include "common.h"
 #include "ffmpeg_audio_codec.h"
+#include "separation_pipeline.h"
 #include "waveform.h"
 #include <algorithm>
 #include <atomic>
@@ -18,7 +19,10 @@
 
 using namespace std;
 
-spleeter::Waveform do_spleeter(const spleeter::Waveform &w) { return w; }
+spleeter::Waveform do_spleeter(const spleeter::WaveformView &w,
+                               std::pmr::memory_resource *memory) {
+  return w.to_waveform(memory);
+}
 
 int main(int argc, char **argv) {
   // char *argvA[4] = {"", "C:\\KwDownload\\song\\44100_32.mp3", "./test2.mp3",
@@ -46,6 +50,8 @@ int main(int argc, char **argv) {
   string output_flename = argv[2];
   int alive_time = std::stoi(argv[3]);
   cout << "load path:" << path << endl;
+  /// 波形数据的拷贝也使用64字节对齐并补齐的内存
+  std::pmr::set_default_resource(spleeter::sample_memory());
   spleeter::CancelToken cancel_token;
 
   thread t([=, &cancel_token]() {
@@ -59,105 +65,73 @@ int main(int argc, char **argv) {
     static_assert(boundary_nb_samples < segment_nb_samples, "");
 #endif
 
-    spleeter::AudioDecoder decoder(path, &cancel_token);
+    /// 同一任务的解码器和编码器共用一个帧/包缓冲池
+    auto pool = std::make_shared<avpro::MediaPool>();
+    spleeter::AudioDecoder decoder(path, &cancel_token, pool);
     if (!decoder) {
       cout << "decoder create failed";
       return -1;
     }
-    spleeter::AudioEncoder encoder(output_flename, &cancel_token);
+    spleeter::AudioEncoder encoder(output_flename, &cancel_token, pool);
     if (!encoder) {
       cout << "encoder create failed";
       return -1;
     }
-#if ENABLE_SEGMENT
-    spleeter::Waveform last_boundary_samples{
-        .nb_frames = 0,
-        .nb_channels = spleeter::constants::kChannelNum,
-        .data = {}};
-#endif
-    // std::unique_ptr<spleeter::Waveform> last_boundary_samples;
-
-    while (1) {
-      unique_ptr<spleeter::Waveform> waveform;
-      int decode_ret = decoder.Decode(waveform, segment_nb_samples);
-
-      if (decode_ret == 0) {
-        cout << "decode failed(canceled):" << path << endl;
-        return 1;
-      } else if (decode_ret < 0) {
-        cout << "decode failed(error):" << path << endl;
-        return 1;
-      }
-      if (!waveform) {
-        cout << "decode finished:" << path << endl;
-      } else {
-        cout << "decode success,nb_samples:"
-             << (waveform ? waveform->nb_frames : 0) << endl;
-      }
-
-      if (waveform) {
-
-        spleeter::Waveform *w_ptr;
-#if ENABLE_SEGMENT
-        spleeter::Waveform sw = last_boundary_samples + *waveform;
-        w_ptr = &sw;
-#else
-        w_ptr = waveform.get();
-#endif
 
-        /// do spleeter with w
-        spleeter::Waveform spleeter_waveform = do_spleeter(*w_ptr);
+    /// 解码、处理、编码流水线执行，处理阶段多线程并行
+    /// 分段的采样缓冲区回收复用，不再反复向系统申请
+    auto memory = std::make_shared<spleeter::RecyclingResource>();
+    spleeter::SeparationPipeline pipeline(
+        {.segment_nb_samples = segment_nb_samples,
 #if ENABLE_SEGMENT
-        std::size_t next_boundary_n;
-        if (waveform->nb_frames < segment_nb_samples) {
-          /// 已经解码完成。
-          next_boundary_n = 0;
-        } else {
-          next_boundary_n = boundary_nb_samples;
-        }
-
-        spleeter_waveform = spleeter_waveform.sub_frames(
-            last_boundary_samples.nb_frames / 2,
-            spleeter_waveform.nb_frames - next_boundary_n / 2);
-#endif
-
-        // #if ENABLE_SEGMENT
-        //         spleeter::Waveform w = last_boundary_samples + *waveform;
-
-        // #if ENABLE_SEGMENT_RESTORE
-
-        // #endif
-        // #else
-        //         spleeter::Waveform w = *waveform;
-        // #endif
-        int encode_ret = encoder.Encode(spleeter_waveform);
-        if (encode_ret == 0) {
-          cout << "encode failed(canceled):" << endl;
-          return 1;
-        } else if (encode_ret < 0) {
-          cout << "encode failed(error):" << endl;
-          return 1;
-        }
-        cout << "encode success(" << encoder.LastTimestamp() << "ms)" << endl;
-#if ENABLE_SEGMENT
-        last_boundary_samples =
-            waveform->sub_end_frames(waveform->nb_frames - next_boundary_n);
+         .boundary_nb_samples = boundary_nb_samples,
+#else
+         .boundary_nb_samples = 0,
 #endif
-        waveform.reset();
-
-      } else {
-        int encode_finish_ret = encoder.FinishEncode();
-        if (encode_finish_ret == 0) {
-          cout << "finish encode failed(canceled):" << endl;
-          return 1;
-        } else if (encode_finish_ret < 0) {
-          cout << "finish encode failed(error):" << endl;
-          return 1;
-        }
-        cout << "encode complete:" << output_flename << endl;
-        break;
-      }
+         .queue_depth = 2,
+         .nb_process_threads = 2,
+         .memory = memory},
+        [memory](const spleeter::WaveformView &w) {
+          return do_spleeter(w, memory.get());
+        },
+        &cancel_token);
+    int ret = pipeline.run(decoder, encoder);
+    if (ret == 0) {
+      cout << "separation failed(canceled):" << path << endl;
+      return 1;
+    } else if (ret < 0) {
+      cout << "separation failed(error):" << path << endl;
+      return 1;
     }
+    cout << "encode complete:" << output_flename << endl;
+
+    const auto &stats = pipeline.stats();
+    auto print_stage = [](const char *name,
+                          const spleeter::StageStats &stage) {
+      cout << name << " segments:" << stage.nb_segments
+           << ",busy:" << stage.busy_seconds << "s"
+           << ",wait:" << stage.wait_seconds << "s"
+           << ",speed:"
+           << stage.frames_per_second() / spleeter::constants::kSampleRate
+           << "x" << endl;
+    };
+    print_stage("decode", stats.decode);
+    print_stage("process", stats.process);
+    print_stage("encode", stats.encode);
+    /// 输入读取量与音频实际使用量，差值为视频等其他流和封装开销
+    const auto demux_stats = decoder.Stats();
+    cout << "input read:" << demux_stats.bytes_read << "B"
+         << ",audio used:" << demux_stats.bytes_used << "B" << endl;
+    cout << "elapsed:" << stats.elapsed_seconds << "s" << endl;
+    cout << "buffers allocated:" << stats.memory.allocations
+         << ",reused:" << stats.memory.reuses
+         << ",cached:" << stats.memory.cached_bytes << "B" << endl;
+
+    auto pool_stats = pool->stats();
+    cout << "pool acquires:" << pool_stats.acquires() << "("
+         << pool_stats.acquires_per_second() << "/s)"
+         << ",allocs:" << pool_stats.allocs() << "("
+         << pool_stats.allocs_per_second() << "/s)" << endl;
 
     return 0;
   });
@@ -0,0 +1,83 @@
+#include "recycling_resource.h"
+#include <algorithm>
+
+namespace spleeter {
+
+RecyclingResource::RecyclingResource(std::size_t max_cached_bytes,
+                                     std::pmr::memory_resource *upstream)
+    : upstream_(upstream), max_cached_bytes_(max_cached_bytes) {}
+
+std::size_t RecyclingResource::size_class(std::size_t bytes) {
+  /* Granularity is an eighth of the enclosing power of two, at least one
+   * cache line. */
+  std::size_t power = kAlignment;
+  while (power < bytes) {
+    power <<= 1;
+  }
+  const std::size_t step = std::max(kAlignment, power / 8);
+  return (bytes + step - 1) / step * step;
+}
+
+void *RecyclingResource::do_allocate(std::size_t bytes,
+                                     std::size_t alignment) {
+  if (alignment > kAlignment) {
+    return upstream_->allocate(bytes, alignment);
+  }
+  const std::size_t size = size_class(bytes);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.allocations++;
+    auto it = free_blocks_.find(size);
+    if (it != free_blocks_.end() && !it->second.empty()) {
+      void *p = it->second.back();
+      it->second.pop_back();
+      stats_.reuses++;
+      stats_.cached_bytes -= size;
+      return p;
+    }
+  }
+  return upstream_->allocate(size, kAlignment);
+}
+
+void RecyclingResource::do_deallocate(void *p, std::size_t bytes,
+                                      std::size_t alignment) {
+  if (alignment > kAlignment) {
+    upstream_->deallocate(p, bytes, alignment);
+    return;
+  }
+  const std::size_t size = size_class(bytes);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stats_.cached_bytes + size <= max_cached_bytes_) {
+      free_blocks_[size].push_back(p);
+      stats_.cached_bytes += size;
+      return;
+    }
+  }
+  upstream_->deallocate(p, size, kAlignment);
+}
+
+bool RecyclingResource::do_is_equal(
+    const std::pmr::memory_resource &other) const noexcept {
+  return this == &other;
+}
+
+void RecyclingResource::release() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &entry : free_blocks_) {
+    for (void *p : entry.second) {
+      upstream_->deallocate(p, entry.first, kAlignment);
+    }
+  }
+  free_blocks_.clear();
+  stats_.cached_bytes = 0;
+}
+
+RecyclingResourceStats RecyclingResource::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+RecyclingResource::~RecyclingResource() { release(); }
+
+} // namespace spleeter
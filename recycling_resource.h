@@ -0,0 +1,68 @@
+#ifndef SPLEETER_RECYCLING_RESOURCE_H
+#define SPLEETER_RECYCLING_RESOURCE_H
+
+#include <cstddef>
+#include "aligned_resource.h"
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+namespace spleeter {
+
+struct RecyclingResourceStats {
+  /// blocks handed out
+  std::int64_t allocations{0};
+  /// of those, blocks that came from the free lists
+  std::int64_t reuses{0};
+  /// bytes currently kept for reuse
+  std::size_t cached_bytes{0};
+};
+
+/// memory_resource that keeps freed blocks and hands them out again for
+/// requests of the same size class, so steady-state Waveform buffers never go
+/// back to the OS. Sizes are rounded up to within 1/8 so segments that differ
+/// by a few frames share blocks. Thread-safe; the resource must outlive every
+/// container using it.
+class RecyclingResource : public std::pmr::memory_resource {
+  static constexpr std::size_t kAlignment = 64;
+
+  std::pmr::memory_resource *upstream_;
+  std::size_t max_cached_bytes_;
+
+  mutable std::mutex mutex_;
+  std::map<std::size_t, std::vector<void *>> free_blocks_;
+  RecyclingResourceStats stats_;
+
+  static std::size_t size_class(std::size_t bytes);
+
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+
+  void do_deallocate(void *p, std::size_t bytes,
+                     std::size_t alignment) override;
+
+  bool do_is_equal(
+      const std::pmr::memory_resource &other) const noexcept override;
+
+public:
+  /// Blocks beyond max_cached_bytes are released to upstream on free.
+  explicit RecyclingResource(
+      std::size_t max_cached_bytes = SIZE_MAX,
+      std::pmr::memory_resource *upstream = sample_memory());
+
+  RecyclingResource(const RecyclingResource &) = delete;
+
+  RecyclingResource &operator=(const RecyclingResource &) = delete;
+
+  /// Give every cached block back to upstream.
+  void release();
+
+  RecyclingResourceStats stats() const;
+
+  ~RecyclingResource() override;
+};
+
+} // namespace spleeter
+
+#endif
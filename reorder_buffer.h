@@ -0,0 +1,71 @@
+#ifndef SPLEETER_REORDER_BUFFER_H
+#define SPLEETER_REORDER_BUFFER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <mutex>
+
+namespace spleeter {
+
+/// Hands out items in index order no matter in which order they were pushed.
+/// push blocks while the index is capacity or more ahead of the next one to
+/// pop, so a slow item cannot make the buffer grow without bound. After close,
+/// pop drains the items that are in order and then fails.
+template <typename T> class ReorderBuffer {
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::condition_variable room_;
+  std::map<std::size_t, T> items_;
+  std::size_t next_{0};
+  std::size_t capacity_;
+  bool closed_{false};
+
+public:
+  explicit ReorderBuffer(std::size_t capacity) : capacity_(capacity) {}
+
+  ReorderBuffer(const ReorderBuffer &) = delete;
+
+  ReorderBuffer &operator=(const ReorderBuffer &) = delete;
+
+  bool push(std::size_t index, T item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    room_.wait(lock,
+               [&] { return closed_ || index < next_ + capacity_; });
+    if (closed_) {
+      return false;
+    }
+    items_.emplace(index, std::move(item));
+    if (index == next_) {
+      ready_.notify_all();
+    }
+    return true;
+  }
+
+  bool pop(T &item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_.wait(lock, [this] {
+      return closed_ || (!items_.empty() && items_.begin()->first == next_);
+    });
+    auto it = items_.begin();
+    if (it == items_.end() || it->first != next_) {
+      return false;
+    }
+    item = std::move(it->second);
+    items_.erase(it);
+    ++next_;
+    room_.notify_all();
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    ready_.notify_all();
+    room_.notify_all();
+  }
+};
+
+} // namespace spleeter
+
+#endif
@@ -0,0 +1,199 @@
+#include "sample_converter.h"
+#include "favutil/sample_kernels.h"
+#include <cstdio>
+#include <cstring>
+
+extern "C" {
+#include "libavutil/error.h"
+}
+
+namespace spleeter {
+namespace codec {
+
+/* Loops for the sample types without a vectorized kernel, float goes through
+ * avpro::kernels instead. */
+template <typename T>
+static void interleave(uint8_t *dst, const uint8_t *const *src,
+                       int nb_channels, int nb_samples) {
+  T *out = reinterpret_cast<T *>(dst);
+  if (nb_channels == 2) {
+    /* The common case, kept simple enough to be vectorized. */
+    const T *l = reinterpret_cast<const T *>(src[0]);
+    const T *r = reinterpret_cast<const T *>(src[1]);
+    for (int i = 0; i < nb_samples; ++i) {
+      out[2 * i] = l[i];
+      out[2 * i + 1] = r[i];
+    }
+    return;
+  }
+  for (int c = 0; c < nb_channels; ++c) {
+    const T *in = reinterpret_cast<const T *>(src[c]);
+    for (int i = 0; i < nb_samples; ++i) {
+      out[i * nb_channels + c] = in[i];
+    }
+  }
+}
+
+template <typename T>
+static void deinterleave(uint8_t *const *dst, const uint8_t *src,
+                         int nb_channels, int nb_samples) {
+  const T *in = reinterpret_cast<const T *>(src);
+  if (nb_channels == 2) {
+    T *l = reinterpret_cast<T *>(dst[0]);
+    T *r = reinterpret_cast<T *>(dst[1]);
+    for (int i = 0; i < nb_samples; ++i) {
+      l[i] = in[2 * i];
+      r[i] = in[2 * i + 1];
+    }
+    return;
+  }
+  for (int c = 0; c < nb_channels; ++c) {
+    T *out = reinterpret_cast<T *>(dst[c]);
+    for (int i = 0; i < nb_samples; ++i) {
+      out[i] = in[i * nb_channels + c];
+    }
+  }
+}
+
+template <typename T>
+static void convert_layout(SampleConverter::Mode mode, uint8_t *const *out,
+                           const uint8_t *const *in, int nb_channels,
+                           int nb_samples) {
+  if (mode == SampleConverter::Mode::kInterleave) {
+    interleave<T>(out[0], in, nb_channels, nb_samples);
+  } else {
+    deinterleave<T>(out, in[0], nb_channels, nb_samples);
+  }
+}
+
+static void convert_float_layout(SampleConverter::Mode mode,
+                                 uint8_t *const *out, const uint8_t *const *in,
+                                 int nb_channels, int nb_samples) {
+  if (mode == SampleConverter::Mode::kInterleave) {
+    avpro::kernels::interleave(reinterpret_cast<float *>(out[0]),
+                               reinterpret_cast<const float *const *>(in),
+                               nb_channels, nb_samples);
+  } else {
+    avpro::kernels::deinterleave(reinterpret_cast<float *const *>(out),
+                                 reinterpret_cast<const float *>(in[0]),
+                                 nb_channels, nb_samples);
+  }
+}
+
+int SampleConverter::init(const AVChannelLayout *in_ch_layout,
+                          AVSampleFormat in_sample_fmt, int in_sample_rate,
+                          const AVChannelLayout *out_ch_layout,
+                          AVSampleFormat out_sample_fmt, int out_sample_rate) {
+  int error;
+
+  swr_free(&swr_);
+  av_channel_layout_uninit(&in_ch_layout_);
+  if ((error = av_channel_layout_copy(&in_ch_layout_, in_ch_layout)) < 0) {
+    return error;
+  }
+  in_sample_fmt_ = in_sample_fmt;
+  in_sample_rate_ = in_sample_rate;
+  nb_channels_ = out_ch_layout->nb_channels;
+  sample_size_ = av_get_bytes_per_sample(out_sample_fmt);
+
+  mode_ = Mode::kResample;
+  if (in_sample_rate == out_sample_rate &&
+      !av_channel_layout_compare(in_ch_layout, out_ch_layout)) {
+    if (in_sample_fmt == out_sample_fmt) {
+      mode_ = Mode::kCopy;
+    } else if (av_get_packed_sample_fmt(in_sample_fmt) ==
+                   av_get_packed_sample_fmt(out_sample_fmt) &&
+               nb_channels_ > 1) {
+      mode_ = av_sample_fmt_is_planar(in_sample_fmt) ? Mode::kInterleave
+                                                     : Mode::kDeinterleave;
+    }
+  }
+  if (mode_ != Mode::kResample) {
+    return 0;
+  }
+
+  if ((error = swr_alloc_set_opts2(&swr_, out_ch_layout, out_sample_fmt,
+                                   out_sample_rate, in_ch_layout,
+                                   in_sample_fmt, in_sample_rate, 0, NULL)) <
+      0) {
+    fprintf(stderr, "Could not allocate resample context\n");
+    return error;
+  }
+  if ((error = swr_init(swr_)) < 0) {
+    fprintf(stderr, "Could not open resample context\n");
+    swr_free(&swr_);
+    return error;
+  }
+  return 0;
+}
+
+bool SampleConverter::accepts(const AVChannelLayout *ch_layout,
+                              AVSampleFormat sample_fmt,
+                              int sample_rate) const {
+  return sample_fmt == in_sample_fmt_ && sample_rate == in_sample_rate_ &&
+         !av_channel_layout_compare(ch_layout, &in_ch_layout_);
+}
+
+int SampleConverter::get_out_samples(int nb_samples) {
+  if (mode_ == Mode::kResample) {
+    return swr_get_out_samples(swr_, nb_samples);
+  }
+  return nb_samples;
+}
+
+int SampleConverter::convert(uint8_t **out, int out_count, const uint8_t **in,
+                             int in_count) {
+  if (mode_ == Mode::kResample) {
+    return swr_convert(swr_, out, out_count, in, in_count);
+  }
+
+  /* Nothing is buffered, so there is nothing to flush. */
+  if (!in || in_count <= 0) {
+    return 0;
+  }
+  if (out_count < in_count) {
+    return AVERROR(EINVAL);
+  }
+
+  if (mode_ == Mode::kCopy) {
+    av_samples_copy(out, const_cast<uint8_t *const *>(in), 0, 0, in_count,
+                    nb_channels_, in_sample_fmt_);
+    return in_count;
+  }
+  if (av_get_packed_sample_fmt(in_sample_fmt_) == AV_SAMPLE_FMT_FLT) {
+    convert_float_layout(mode_, out, in, nb_channels_, in_count);
+    return in_count;
+  }
+  switch (sample_size_) {
+  case 1:
+    convert_layout<uint8_t>(mode_, out, in, nb_channels_, in_count);
+    break;
+  case 2:
+    convert_layout<uint16_t>(mode_, out, in, nb_channels_, in_count);
+    break;
+  case 4:
+    convert_layout<uint32_t>(mode_, out, in, nb_channels_, in_count);
+    break;
+  case 8:
+    convert_layout<uint64_t>(mode_, out, in, nb_channels_, in_count);
+    break;
+  default:
+    return AVERROR_BUG;
+  }
+  return in_count;
+}
+
+int SampleConverter::reset() {
+  if (mode_ == Mode::kResample) {
+    return swr_init(swr_);
+  }
+  return 0;
+}
+
+SampleConverter::~SampleConverter() {
+  swr_free(&swr_);
+  av_channel_layout_uninit(&in_ch_layout_);
+}
+
+} // namespace codec
+} // namespace spleeter
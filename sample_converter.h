@@ -0,0 +1,91 @@
+#ifndef SPLEETER_SAMPLE_CONVERTER_H
+#define SPLEETER_SAMPLE_CONVERTER_H
+extern "C" {
+#include "libavutil/channel_layout.h"
+#include "libavutil/samplefmt.h"
+#include "libswresample/swresample.h"
+}
+
+#include "sample_types.h"
+#include <cstdint>
+#include <type_traits>
+
+namespace spleeter {
+namespace codec {
+
+/// AVSampleFormat whose buffers have the memory layout of
+/// BasicWaveform<Sample, Layout>. Half samples have no FFmpeg format.
+template <typename Sample, typename Layout>
+constexpr AVSampleFormat av_sample_format() {
+  constexpr bool planar = std::is_same_v<Layout, Planar>;
+  if constexpr (std::is_same_v<Sample, float>) {
+    return planar ? AV_SAMPLE_FMT_FLTP : AV_SAMPLE_FMT_FLT;
+  } else {
+    static_assert(std::is_same_v<Sample, std::int16_t>,
+                  "no FFmpeg sample format for this sample type");
+    return planar ? AV_SAMPLE_FMT_S16P : AV_SAMPLE_FMT_S16;
+  }
+}
+
+/// swr_convert with a bypass: when rate and channel layout already match,
+/// samples are copied, interleaved or deinterleaved directly and no
+/// SwrContext is created. The calls mirror the swr ones, including the NULL
+/// input flush.
+class SampleConverter {
+public:
+  enum class Mode {
+    /// anything else, through libswresample
+    kResample,
+    /// same format, straight copy
+    kCopy,
+    /// planar to the packed variant of the same sample type
+    kInterleave,
+    /// packed to the planar variant of the same sample type
+    kDeinterleave,
+  };
+
+private:
+  Mode mode_{Mode::kResample};
+  SwrContext *swr_{nullptr};
+  AVChannelLayout in_ch_layout_{};
+  AVSampleFormat in_sample_fmt_{AV_SAMPLE_FMT_NONE};
+  int in_sample_rate_{0};
+  int nb_channels_{0};
+  int sample_size_{0};
+
+public:
+  SampleConverter() = default;
+
+  SampleConverter(const SampleConverter &) = delete;
+
+  SampleConverter &operator=(const SampleConverter &) = delete;
+
+  /// Returns 0 or a negative AVERROR, a previous setup is released first.
+  int init(const AVChannelLayout *in_ch_layout, AVSampleFormat in_sample_fmt,
+           int in_sample_rate, const AVChannelLayout *out_ch_layout,
+           AVSampleFormat out_sample_fmt, int out_sample_rate);
+
+  /// Whether input of this shape is what init was called with.
+  bool accepts(const AVChannelLayout *ch_layout, AVSampleFormat sample_fmt,
+               int sample_rate) const;
+
+  /// Upper bound of the output of converting nb_samples more samples, see
+  /// swr_get_out_samples.
+  int get_out_samples(int nb_samples);
+
+  /// Returns the number of samples written or a negative AVERROR. The bypass
+  /// modes buffer nothing, so out_count must cover in_count there.
+  int convert(uint8_t **out, int out_count, const uint8_t **in, int in_count);
+
+  /// Drop samples buffered for resampling, e.g. after a seek.
+  int reset();
+
+  Mode mode() const { return mode_; }
+
+  ~SampleConverter();
+};
+
+} // namespace codec
+} // namespace spleeter
+
+#endif
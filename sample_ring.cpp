@@ -0,0 +1,144 @@
+#include "sample_ring.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+extern "C" {
+#include "libavutil/error.h"
+}
+
+namespace spleeter {
+namespace codec {
+
+int SampleRing::init(AVSampleFormat sample_fmt, int nb_channels,
+                     int capacity) {
+  free_planes();
+  sample_fmt_ = sample_fmt;
+  if (av_sample_fmt_is_planar(sample_fmt)) {
+    nb_planes_ = nb_channels;
+    sample_size_ = av_get_bytes_per_sample(sample_fmt);
+  } else {
+    nb_planes_ = 1;
+    sample_size_ = av_get_bytes_per_sample(sample_fmt) * nb_channels;
+  }
+  capacity_ = 0;
+  head_.store(0, std::memory_order_relaxed);
+  tail_.store(0, std::memory_order_relaxed);
+  if (sample_size_ <= 0 || nb_planes_ <= 0) {
+    return AVERROR(EINVAL);
+  }
+  return reserve(capacity);
+}
+
+int SampleRing::reserve(int capacity) {
+  if (capacity <= capacity_) {
+    return 0;
+  }
+
+  std::vector<uint8_t *> planes(nb_planes_, nullptr);
+  for (auto &plane : planes) {
+    plane = static_cast<uint8_t *>(
+        ::operator new(static_cast<std::size_t>(capacity) * sample_size_,
+                       std::align_val_t(kCacheLine), std::nothrow));
+    if (!plane) {
+      for (auto &p : planes) {
+        ::operator delete(p, std::align_val_t(kCacheLine));
+      }
+      return AVERROR(ENOMEM);
+    }
+  }
+
+  /* Move the buffered samples to the front of the new planes. */
+  const int nb_samples = size();
+  const std::uint64_t tail = tail_.load(std::memory_order_relaxed);
+  if (nb_samples > 0) {
+    copy_out(planes.data(), planes_.data(), tail, nb_samples);
+  }
+  free_planes();
+  planes_ = std::move(planes);
+  capacity_ = capacity;
+  tail_.store(0, std::memory_order_relaxed);
+  head_.store(nb_samples, std::memory_order_relaxed);
+  return 0;
+}
+
+void SampleRing::reset() {
+  head_.store(0, std::memory_order_relaxed);
+  tail_.store(0, std::memory_order_relaxed);
+}
+
+int SampleRing::size() const {
+  return static_cast<int>(head_.load(std::memory_order_acquire) -
+                          tail_.load(std::memory_order_relaxed));
+}
+
+int SampleRing::space() const {
+  return capacity_ - static_cast<int>(head_.load(std::memory_order_relaxed) -
+                                      tail_.load(std::memory_order_acquire));
+}
+
+void SampleRing::copy_in(uint8_t *const *planes, std::uint64_t position,
+                         const uint8_t *const *data, int nb_samples) {
+  const int start = static_cast<int>(position % capacity_);
+  const int first = std::min(nb_samples, capacity_ - start);
+  for (int i = 0; i < nb_planes_; ++i) {
+    const uint8_t *src = data[i];
+    memcpy(planes[i] + static_cast<std::size_t>(start) * sample_size_, src,
+           static_cast<std::size_t>(first) * sample_size_);
+    if (first < nb_samples) {
+      memcpy(planes[i], src + static_cast<std::size_t>(first) * sample_size_,
+             static_cast<std::size_t>(nb_samples - first) * sample_size_);
+    }
+  }
+}
+
+void SampleRing::copy_out(uint8_t *const *data, uint8_t *const *planes,
+                          std::uint64_t position, int nb_samples) const {
+  const int start = static_cast<int>(position % capacity_);
+  const int first = std::min(nb_samples, capacity_ - start);
+  for (int i = 0; i < nb_planes_; ++i) {
+    uint8_t *dst = data[i];
+    memcpy(dst, planes[i] + static_cast<std::size_t>(start) * sample_size_,
+           static_cast<std::size_t>(first) * sample_size_);
+    if (first < nb_samples) {
+      memcpy(dst + static_cast<std::size_t>(first) * sample_size_, planes[i],
+             static_cast<std::size_t>(nb_samples - first) * sample_size_);
+    }
+  }
+}
+
+int SampleRing::write(const uint8_t *const *data, int nb_samples) {
+  const std::uint64_t head = head_.load(std::memory_order_relaxed);
+  const int n = std::min(nb_samples, space());
+  if (n <= 0) {
+    return 0;
+  }
+  copy_in(planes_.data(), head, data, n);
+  /* Publish the samples only once they are in place. */
+  head_.store(head + n, std::memory_order_release);
+  return n;
+}
+
+int SampleRing::read(uint8_t *const *data, int nb_samples) {
+  const std::uint64_t tail = tail_.load(std::memory_order_relaxed);
+  const int n = std::min(nb_samples, size());
+  if (n <= 0) {
+    return 0;
+  }
+  copy_out(data, planes_.data(), tail, n);
+  /* Hand the room back only once the samples are copied out. */
+  tail_.store(tail + n, std::memory_order_release);
+  return n;
+}
+
+void SampleRing::free_planes() {
+  for (auto plane : planes_) {
+    ::operator delete(plane, std::align_val_t(kCacheLine));
+  }
+  planes_.clear();
+}
+
+SampleRing::~SampleRing() { free_planes(); }
+
+} // namespace codec
+} // namespace spleeter
@@ -0,0 +1,78 @@
+#ifndef SPLEETER_SAMPLE_RING_H
+#define SPLEETER_SAMPLE_RING_H
+extern "C" {
+#include "libavutil/samplefmt.h"
+}
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace spleeter {
+namespace codec {
+
+/// Fixed-capacity single-producer/single-consumer ring of audio samples, a
+/// drop-in for AVAudioFifo that never reallocates on write. Planar formats
+/// keep one cache-line aligned plane per channel. One thread may write while another
+/// reads; init, reserve and reset need both sides to be idle.
+class SampleRing {
+  static constexpr std::size_t kCacheLine = 64;
+
+  /// producer position in samples, only ever increases
+  alignas(kCacheLine) std::atomic<std::uint64_t> head_{0};
+  /// consumer position in samples, only ever increases
+  alignas(kCacheLine) std::atomic<std::uint64_t> tail_{0};
+
+  alignas(kCacheLine) AVSampleFormat sample_fmt_{AV_SAMPLE_FMT_NONE};
+  int nb_planes_{0};
+  /// bytes of one sample in one plane
+  int sample_size_{0};
+  int capacity_{0};
+  std::vector<uint8_t *> planes_;
+
+  void free_planes();
+
+  void copy_in(uint8_t *const *planes, std::uint64_t position,
+               const uint8_t *const *data, int nb_samples);
+
+  void copy_out(uint8_t *const *data, uint8_t *const *planes,
+                std::uint64_t position, int nb_samples) const;
+
+public:
+  SampleRing() = default;
+
+  SampleRing(const SampleRing &) = delete;
+
+  SampleRing &operator=(const SampleRing &) = delete;
+
+  /// Returns 0 or a negative AVERROR.
+  int init(AVSampleFormat sample_fmt, int nb_channels, int capacity);
+
+  /// Grow to at least capacity samples keeping the buffered ones.
+  int reserve(int capacity);
+
+  /// Drop every buffered sample.
+  void reset();
+
+  /// Samples buffered, safe to call from the consumer.
+  int size() const;
+
+  /// Free room in samples, safe to call from the producer.
+  int space() const;
+
+  int capacity() const { return capacity_; }
+
+  /// Copy up to nb_samples samples in, returns the number written.
+  int write(const uint8_t *const *data, int nb_samples);
+
+  /// Copy up to nb_samples samples out, returns the number read.
+  int read(uint8_t *const *data, int nb_samples);
+
+  ~SampleRing();
+};
+
+} // namespace codec
+} // namespace spleeter
+
+#endif
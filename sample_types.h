@@ -0,0 +1,133 @@
+#ifndef SPLEETER_SAMPLE_TYPES_H
+#define SPLEETER_SAMPLE_TYPES_H
+
+#include "favutil/sample_kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace spleeter {
+
+/// Layout tag: frames one after another, the channels of a frame adjacent.
+struct Interleaved {};
+
+/// Layout tag: one plane per channel, plane c starts at c * nb_frames.
+struct Planar {};
+
+/// IEEE 754 binary16 storage. Only for keeping samples small, arithmetic
+/// goes through float.
+struct Half {
+  std::uint16_t bits;
+
+  /// Rounded to nearest even, out of range values become infinity.
+  static Half from_float(float value) {
+    std::uint32_t x;
+    std::memcpy(&x, &value, sizeof(x));
+    const std::uint16_t sign = (x >> 16) & 0x8000;
+    std::uint32_t mantissa = x & 0x7fffff;
+    const int exponent = static_cast<int>((x >> 23) & 0xff) - 127 + 15;
+
+    if (((x >> 23) & 0xff) == 0xff) {
+      return Half{static_cast<std::uint16_t>(sign | 0x7c00 |
+                                             (mantissa ? 0x200 : 0))};
+    }
+    if (exponent >= 0x1f) {
+      return Half{static_cast<std::uint16_t>(sign | 0x7c00)};
+    }
+    if (exponent <= 0) {
+      /* Subnormal, the implicit bit becomes explicit. */
+      if (exponent < -10) {
+        return Half{sign};
+      }
+      mantissa |= 0x800000;
+      const int shift = 14 - exponent;
+      std::uint32_t h = mantissa >> shift;
+      const std::uint32_t rest = mantissa & ((1u << shift) - 1);
+      const std::uint32_t halfway = 1u << (shift - 1);
+      if (rest > halfway || (rest == halfway && (h & 1))) {
+        ++h;
+      }
+      return Half{static_cast<std::uint16_t>(sign | h)};
+    }
+    std::uint32_t h = (static_cast<std::uint32_t>(exponent) << 10) |
+                      (mantissa >> 13);
+    const std::uint32_t rest = mantissa & 0x1fff;
+    /* A carry out of the mantissa correctly bumps the exponent. */
+    if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) {
+      ++h;
+    }
+    return Half{static_cast<std::uint16_t>(sign | h)};
+  }
+
+  float to_float() const {
+    const std::uint32_t sign = static_cast<std::uint32_t>(bits & 0x8000) << 16;
+    std::uint32_t exponent = (bits >> 10) & 0x1f;
+    std::uint32_t mantissa = bits & 0x3ff;
+    std::uint32_t x;
+
+    if (exponent == 0x1f) {
+      x = sign | 0x7f800000 | (mantissa << 13);
+    } else if (exponent != 0) {
+      x = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+      x = sign;
+    } else {
+      /* Subnormal, normalize it for the wider exponent. */
+      exponent = 127 - 15 + 1;
+      while (!(mantissa & 0x400)) {
+        mantissa <<= 1;
+        --exponent;
+      }
+      x = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+    float value;
+    std::memcpy(&value, &x, sizeof(value));
+    return value;
+  }
+};
+
+/// One sample converted between float ([-1, 1)), int16 and Half. int16
+/// results are rounded to nearest and saturated.
+template <typename To, typename From> inline To sample_cast(From x) {
+  if constexpr (std::is_same_v<To, From>) {
+    return x;
+  } else if constexpr (std::is_same_v<From, Half>) {
+    return sample_cast<To>(x.to_float());
+  } else if constexpr (std::is_same_v<To, Half>) {
+    return Half::from_float(sample_cast<float>(x));
+  } else if constexpr (std::is_same_v<To, float>) {
+    static_assert(std::is_same_v<From, std::int16_t>, "unsupported sample");
+    return x * (1.0f / 32768.0f);
+  } else {
+    static_assert(std::is_same_v<To, std::int16_t> &&
+                      std::is_same_v<From, float>,
+                  "unsupported sample");
+    x = std::min(std::max(x * 32768.0f, -32768.0f), 32767.0f);
+    return static_cast<std::int16_t>(std::lrint(x));
+  }
+}
+
+/// n samples converted with sample_cast, vectorized where a kernel exists.
+template <typename To, typename From>
+inline void convert_samples(To *dst, const From *src, std::size_t n) {
+  if constexpr (std::is_same_v<To, From>) {
+    std::memcpy(dst, src, n * sizeof(To));
+  } else if constexpr (std::is_same_v<To, std::int16_t> &&
+                       std::is_same_v<From, float>) {
+    avpro::kernels::float_to_s16(dst, src, n);
+  } else if constexpr (std::is_same_v<To, float> &&
+                       std::is_same_v<From, std::int16_t>) {
+    avpro::kernels::s16_to_float(dst, src, n);
+  } else {
+    for (std::size_t i = 0; i < n; ++i) {
+      dst[i] = sample_cast<To>(src[i]);
+    }
+  }
+}
+
+} // namespace spleeter
+
+#endif
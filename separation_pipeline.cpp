@@ -0,0 +1,191 @@
+#include "separation_pipeline.h"
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace spleeter {
+
+using Clock = std::chrono::steady_clock;
+
+static double seconds_since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+SeparationPipeline::SeparationPipeline(Options options,
+                                       ProcessFunction process,
+                                       CancelToken *cancel_token)
+    : options_(options), process_(std::move(process)),
+      cancel_token_(cancel_token),
+      memory_(options_.memory ? options_.memory
+                              : std::make_shared<RecyclingResource>()),
+      decoded_(options.queue_depth),
+      processed_(options.queue_depth + options.nb_process_threads) {
+  assert(options_.boundary_nb_samples < options_.segment_nb_samples);
+  assert(options_.nb_process_threads > 0);
+}
+
+void SeparationPipeline::fail(int ret) {
+  int expected = 1;
+  result_.compare_exchange_strong(expected, ret);
+  /* Unblock the other stages, they stop at their next queue operation. */
+  decoded_.close();
+  processed_.close();
+}
+
+void SeparationPipeline::decode_stage(AudioDecoder &decoder) {
+  StageStats &stats = stats_.decode;
+  SegmentStream stream(options_.segment_nb_samples,
+                       options_.boundary_nb_samples, constants::kChannelNum,
+                       memory_.get());
+  int ret = 1;
+
+  auto start = Clock::now();
+  while (1) {
+    /* Decode straight into the buffer of the next window, behind the
+     * overlap it starts with, and no further than the window needs. */
+    Waveform &input = stream.input();
+    const std::size_t nb_buffered = input.nb_frames;
+    const std::size_t nb_wanted = stream.nb_missing();
+    if ((ret = decoder.DecodeAppend(input, nb_wanted)) <= 0) {
+      break;
+    }
+    const std::size_t nb_decoded = input.nb_frames - nb_buffered;
+    stats.nb_frames += nb_decoded;
+    if (nb_decoded < nb_wanted) {
+      stream.finish();
+    }
+
+    while (auto window = stream.next()) {
+      /* Built in place: assigning a waveform from another resource would
+       * copy it into the default one instead of taking the recycled block. */
+      auto segment = std::make_unique<Segment>(
+          Segment{.index = stats.nb_segments,
+                  .waveform = std::move(window->waveform),
+                  .head = window->head,
+                  .tail = window->tail});
+      stats.nb_segments++;
+      stats.busy_seconds += seconds_since(start);
+
+      start = Clock::now();
+      if (!decoded_.push(std::move(segment))) {
+        return;
+      }
+      stats.wait_seconds += seconds_since(start);
+      start = Clock::now();
+    }
+    if (nb_decoded < nb_wanted) {
+      break;
+    }
+  }
+
+  if (ret <= 0) {
+    fail(ret);
+    return;
+  }
+  decoded_.close();
+}
+
+void SeparationPipeline::process_stage() {
+  StageStats stats;
+  std::unique_ptr<Segment> segment;
+
+  while (1) {
+    auto start = Clock::now();
+    if (!decoded_.pop(segment)) {
+      break;
+    }
+    stats.wait_seconds += seconds_since(start);
+    if (cancel_token_->is_cancelled()) {
+      fail(0);
+      break;
+    }
+
+    start = Clock::now();
+    auto result = std::make_unique<Processed>(
+        Processed{.waveform = process_(segment->waveform), .restored = {}});
+    /* Trimming only narrows the view, the encoder reads it in place. */
+    result->restored =
+        restore_segment_audio(result->waveform, options_.boundary_nb_samples,
+                              segment->head, segment->tail);
+    stats.nb_segments++;
+    stats.nb_frames += result->restored.nb_frames;
+    stats.busy_seconds += seconds_since(start);
+
+    start = Clock::now();
+    if (!processed_.push(segment->index, std::move(result))) {
+      break;
+    }
+    stats.wait_seconds += seconds_since(start);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.process.nb_segments += stats.nb_segments;
+    stats_.process.nb_frames += stats.nb_frames;
+    stats_.process.busy_seconds += stats.busy_seconds;
+    stats_.process.wait_seconds += stats.wait_seconds;
+  }
+  if (--nb_processing_ == 0) {
+    processed_.close();
+  }
+}
+
+void SeparationPipeline::encode_stage(AudioEncoder &encoder) {
+  StageStats &stats = stats_.encode;
+  std::unique_ptr<Processed> processed;
+  int ret;
+
+  while (1) {
+    auto start = Clock::now();
+    if (!processed_.pop(processed)) {
+      break;
+    }
+    stats.wait_seconds += seconds_since(start);
+
+    start = Clock::now();
+    if ((ret = encoder.Encode(processed->restored)) <= 0) {
+      fail(ret);
+      return;
+    }
+    stats.nb_segments++;
+    stats.nb_frames += processed->restored.nb_frames;
+    stats.busy_seconds += seconds_since(start);
+  }
+
+  /* Closed because another stage failed, the output is incomplete. */
+  if (result_ <= 0) {
+    return;
+  }
+  auto start = Clock::now();
+  if ((ret = encoder.FinishEncode()) <= 0) {
+    fail(ret);
+    return;
+  }
+  stats.busy_seconds += seconds_since(start);
+}
+
+int SeparationPipeline::run(AudioDecoder &decoder, AudioEncoder &encoder) {
+  auto start = Clock::now();
+
+  std::thread decode_thread(&SeparationPipeline::decode_stage, this,
+                            std::ref(decoder));
+  std::vector<std::thread> process_threads;
+  nb_processing_ = options_.nb_process_threads;
+  for (std::size_t i = 0; i < options_.nb_process_threads; ++i) {
+    process_threads.emplace_back(&SeparationPipeline::process_stage, this);
+  }
+  /* The calling thread is the encode stage. */
+  encode_stage(encoder);
+  decode_thread.join();
+  for (auto &thread : process_threads) {
+    thread.join();
+  }
+
+  stats_.memory = memory_->stats();
+  stats_.elapsed_seconds = seconds_since(start);
+  return result_;
+}
+
+} // namespace spleeter
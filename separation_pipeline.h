@@ -0,0 +1,125 @@
+#ifndef SPLEETER_SEPARATION_PIPELINE_H
+#define SPLEETER_SEPARATION_PIPELINE_H
+
+#include "blocking_queue.h"
+#include "common.h"
+#include "ffmpeg_audio_codec.h"
+#include "recycling_resource.h"
+#include "reorder_buffer.h"
+#include "waveform.h"
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace spleeter {
+
+/// Work and idle time of one pipeline stage, summed over its threads.
+struct StageStats {
+  std::size_t nb_segments{0};
+  std::size_t nb_frames{0};
+  /// time spent in the stage's own work
+  double busy_seconds{0};
+  /// time spent blocked on the neighbouring queues
+  double wait_seconds{0};
+
+  /// Frames handled per second of work, compare with the sample rate for the
+  /// real-time factor of the stage.
+  double frames_per_second() const {
+    return busy_seconds > 0 ? nb_frames / busy_seconds : 0;
+  }
+};
+
+struct PipelineStats {
+  StageStats decode;
+  StageStats process;
+  StageStats encode;
+  /// sample buffers of the segments, see Options::memory
+  RecyclingResourceStats memory;
+  double elapsed_seconds{0};
+};
+
+/// Runs the segment loop decode -> process -> encode with every stage on its
+/// own thread, connected by bounded queues. Segments are cut like
+/// segment_audio, with boundary_nb_samples of context on each inner side, and
+/// trimmed like restore_segment_audio after processing. With several process
+/// threads segments are processed concurrently and put back in order before
+/// the encoder.
+class SeparationPipeline {
+public:
+  using ProcessFunction = std::function<Waveform(const WaveformView &)>;
+
+  struct Options {
+    std::size_t segment_nb_samples;
+    std::size_t boundary_nb_samples;
+    /// segments waiting between two stages
+    std::size_t queue_depth{2};
+    /// threads running the process function, it must be reentrant if > 1
+    std::size_t nb_process_threads{1};
+    /// recycles segment buffers, share one between pipelines to bound the
+    /// memory of many jobs together; a private one is used if null
+    std::shared_ptr<RecyclingResource> memory{};
+  };
+
+private:
+  /// A segment with its overlap and which sides to trim after process.
+  struct Segment {
+    std::size_t index;
+    Waveform waveform;
+    bool head;
+    bool tail;
+  };
+
+  /// A processed segment and the part of it to encode.
+  struct Processed {
+    Waveform waveform;
+    WaveformView restored;
+  };
+
+  Options options_;
+  ProcessFunction process_;
+  CancelToken *cancel_token_;
+  /// declared before the queues, it outlives the buffers they hold
+  std::shared_ptr<RecyclingResource> memory_;
+
+  BlockingQueue<std::unique_ptr<Segment>> decoded_;
+  ReorderBuffer<std::unique_ptr<Processed>> processed_;
+  /// process threads still running, the last one closes processed_
+  std::atomic<std::size_t> nb_processing_{0};
+  /// first non-success result of a stage, 1 while all is well
+  std::atomic<int> result_{1};
+  std::mutex stats_mutex_;
+  PipelineStats stats_;
+
+  void fail(int ret);
+
+  void decode_stage(AudioDecoder &decoder);
+
+  void process_stage();
+
+  void encode_stage(AudioEncoder &encoder);
+
+public:
+  SeparationPipeline(Options options, ProcessFunction process,
+                     CancelToken *cancel_token);
+
+  SeparationPipeline(const SeparationPipeline &) = delete;
+
+  SeparationPipeline &operator=(const SeparationPipeline &) = delete;
+
+  /// Runs the whole job and finishes the encoder. Returns 1 on success, 0 if
+  /// canceled, a negative value on error. Runs once per pipeline.
+  int run(AudioDecoder &decoder, AudioEncoder &encoder);
+
+  /// Valid after run.
+  const PipelineStats &stats() const { return stats_; }
+
+  /// Resource the segments are allocated from, a process function can
+  /// allocate its result here to have it recycled too.
+  std::pmr::memory_resource *memory_resource() const { return memory_.get(); }
+};
+
+} // namespace spleeter
+
+#endif
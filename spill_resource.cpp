@@ -0,0 +1,123 @@
+#include "spill_resource.h"
+#include <filesystem>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace spleeter {
+
+/// Mappings are rounded up to this, a multiple of the page size everywhere
+/// including the 64 KiB allocation granularity of Windows.
+static constexpr std::size_t kMappingGranularity = 64 << 10;
+
+SpillResource::SpillResource(std::size_t ram_threshold, std::string directory,
+                             std::pmr::memory_resource *upstream)
+    : ram_threshold_(ram_threshold), directory_(std::move(directory)),
+      upstream_(upstream) {
+  if (directory_.empty()) {
+    std::error_code ec;
+    directory_ = std::filesystem::temp_directory_path(ec).string();
+  }
+}
+
+std::size_t SpillResource::mapped_size(std::size_t bytes) {
+  return (bytes + kMappingGranularity - 1) / kMappingGranularity *
+         kMappingGranularity;
+}
+
+#ifdef _WIN32
+void *SpillResource::map_file(std::size_t size) {
+  wchar_t name[MAX_PATH];
+  const std::wstring directory =
+      std::filesystem::path(directory_).wstring();
+  if (!GetTempFileNameW(directory.c_str(), L"spl", 0, name)) {
+    throw std::bad_alloc();
+  }
+  /* Deleted once the file handle and the view are both gone. */
+  HANDLE file = CreateFileW(
+      name, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+      FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw std::bad_alloc();
+  }
+  ULARGE_INTEGER length;
+  length.QuadPart = size;
+  HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READWRITE,
+                                      length.HighPart, length.LowPart, NULL);
+  void *p = mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size)
+                    : NULL;
+  if (mapping) {
+    CloseHandle(mapping);
+  }
+  CloseHandle(file);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void SpillResource::unmap_file(void *p, std::size_t) { UnmapViewOfFile(p); }
+#else
+void *SpillResource::map_file(std::size_t size) {
+  std::string name = directory_ + "/spleeter-spill-XXXXXX";
+  const int fd = mkstemp(name.data());
+  if (fd < 0) {
+    throw std::bad_alloc();
+  }
+  /* The mapping keeps the unlinked file alive, nothing is left behind even
+   * if the process dies. */
+  unlink(name.c_str());
+  void *p = MAP_FAILED;
+  if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+    p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (p == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void SpillResource::unmap_file(void *p, std::size_t size) { munmap(p, size); }
+#endif
+
+void *SpillResource::do_allocate(std::size_t bytes, std::size_t alignment) {
+  /* The choice only depends on the size, do_deallocate repeats it. */
+  if (bytes < ram_threshold_ || alignment > kMappingGranularity) {
+    return upstream_->allocate(bytes, alignment);
+  }
+  const std::size_t size = mapped_size(bytes);
+  void *p = map_file(size);
+  nb_files_++;
+  mapped_bytes_ += size;
+  return p;
+}
+
+void SpillResource::do_deallocate(void *p, std::size_t bytes,
+                                  std::size_t alignment) {
+  if (bytes < ram_threshold_ || alignment > kMappingGranularity) {
+    upstream_->deallocate(p, bytes, alignment);
+    return;
+  }
+  const std::size_t size = mapped_size(bytes);
+  unmap_file(p, size);
+  nb_files_--;
+  mapped_bytes_ -= size;
+}
+
+bool SpillResource::do_is_equal(
+    const std::pmr::memory_resource &other) const noexcept {
+  return this == &other;
+}
+
+SpillResourceStats SpillResource::stats() const {
+  return SpillResourceStats{.nb_files = nb_files_.load(),
+                            .mapped_bytes = mapped_bytes_.load()};
+}
+
+} // namespace spleeter
@@ -0,0 +1,64 @@
+#ifndef SPLEETER_SPILL_RESOURCE_H
+#define SPLEETER_SPILL_RESOURCE_H
+
+#include "aligned_resource.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+
+namespace spleeter {
+
+struct SpillResourceStats {
+  /// blocks currently backed by a temporary file
+  std::int64_t nb_files{0};
+  /// bytes of those blocks
+  std::size_t mapped_bytes{0};
+};
+
+/// memory_resource that keeps small blocks in RAM and backs every block of
+/// at least ram_threshold bytes with a memory-mapped temporary file, so the
+/// OS can page a very long decoded input out to disk instead of running out
+/// of memory. The file is deleted as soon as it is mapped and disappears
+/// with the mapping. Blocks are page aligned; to the containers they are
+/// ordinary memory, so Waveform, views, the segmenter and the encoder read
+/// them unchanged. Thread-safe.
+class SpillResource : public std::pmr::memory_resource {
+  std::size_t ram_threshold_;
+  std::string directory_;
+  std::pmr::memory_resource *upstream_;
+
+  std::atomic<std::int64_t> nb_files_{0};
+  std::atomic<std::size_t> mapped_bytes_{0};
+
+  static std::size_t mapped_size(std::size_t bytes);
+
+  void *map_file(std::size_t size);
+
+  void unmap_file(void *p, std::size_t size);
+
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+
+  void do_deallocate(void *p, std::size_t bytes,
+                     std::size_t alignment) override;
+
+  bool do_is_equal(
+      const std::pmr::memory_resource &other) const noexcept override;
+
+public:
+  /// Files go to directory, the system temporary directory if empty.
+  explicit SpillResource(std::size_t ram_threshold,
+                         std::string directory = std::string(),
+                         std::pmr::memory_resource *upstream = sample_memory());
+
+  SpillResource(const SpillResource &) = delete;
+
+  SpillResource &operator=(const SpillResource &) = delete;
+
+  SpillResourceStats stats() const;
+};
+
+} // namespace spleeter
+
+#endif
@@ -0,0 +1,564 @@
+#include "common.h"
+#include "ffmpeg_audio_encoder.h"
+#include "reorder_buffer.h"
+#include "sample_ring.h"
+#include "sample_types.h"
+#include "waveform_rope.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory_resource>
+#include <thread>
+#include <vector>
+
+/// Checks of the sample buffers and containers that need no media file.
+/// Every failed check is reported, the exit code is the number of failures.
+
+static int nb_failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,         \
+              #condition);                                                     \
+      ++nb_failures;                                                           \
+    }                                                                          \
+  } while (0)
+
+using namespace spleeter;
+
+/// Interleaved stereo frames first..first+nb_frames, sample = 2 * frame + c.
+static std::vector<float> stereo_frames(int first, int nb_frames) {
+  std::vector<float> samples(static_cast<std::size_t>(nb_frames) * 2);
+  for (int i = 0; i < nb_frames; ++i) {
+    samples[2 * i] = static_cast<float>(2 * (first + i));
+    samples[2 * i + 1] = static_cast<float>(2 * (first + i) + 1);
+  }
+  return samples;
+}
+
+static int ring_write(codec::SampleRing &ring, const std::vector<float> &in,
+                      int nb_samples) {
+  const uint8_t *data[1] = {reinterpret_cast<const uint8_t *>(in.data())};
+  return ring.write(data, nb_samples);
+}
+
+static int ring_read(codec::SampleRing &ring, std::vector<float> &out,
+                     int nb_samples) {
+  out.assign(static_cast<std::size_t>(nb_samples) * 2, -1.0f);
+  uint8_t *data[1] = {reinterpret_cast<uint8_t *>(out.data())};
+  return ring.read(data, nb_samples);
+}
+
+static void test_ring_wrap_around() {
+  codec::SampleRing ring;
+  std::vector<float> out;
+  CHECK(ring.init(AV_SAMPLE_FMT_FLT, 2, 8) == 0);
+
+  CHECK(ring_write(ring, stereo_frames(0, 6), 6) == 6);
+  CHECK(ring_read(ring, out, 4) == 4);
+  CHECK(out == stereo_frames(0, 4));
+
+  /* Starts at position 6 of 8, so the write wraps to the front. */
+  CHECK(ring_write(ring, stereo_frames(6, 6), 6) == 6);
+  CHECK(ring.size() == 8);
+  CHECK(ring.space() == 0);
+  CHECK(ring_write(ring, stereo_frames(12, 1), 1) == 0);
+
+  CHECK(ring_read(ring, out, 8) == 8);
+  CHECK(out == stereo_frames(4, 8));
+  CHECK(ring.size() == 0);
+  CHECK(ring_read(ring, out, 1) == 0);
+}
+
+static void test_ring_partial_write() {
+  codec::SampleRing ring;
+  std::vector<float> out;
+  CHECK(ring.init(AV_SAMPLE_FMT_FLT, 2, 4) == 0);
+
+  CHECK(ring_write(ring, stereo_frames(0, 6), 6) == 4);
+  CHECK(ring_read(ring, out, 6) == 4);
+  out.resize(8);
+  CHECK(out == stereo_frames(0, 4));
+}
+
+/// The decoder keeps what did not fit into the caller's buffer in the ring
+/// and grows it when a frame is larger, the order must survive both.
+static void test_ring_carry_over_planar() {
+  codec::SampleRing ring;
+  std::vector<float> left(16), right(16);
+  auto write = [&](int first, int nb_samples) {
+    std::vector<float> l(nb_samples), r(nb_samples);
+    for (int i = 0; i < nb_samples; ++i) {
+      l[i] = static_cast<float>(first + i);
+      r[i] = static_cast<float>(-(first + i));
+    }
+    const uint8_t *data[2] = {reinterpret_cast<const uint8_t *>(l.data()),
+                              reinterpret_cast<const uint8_t *>(r.data())};
+    return ring.write(data, nb_samples);
+  };
+  auto read = [&](int nb_samples) {
+    uint8_t *data[2] = {reinterpret_cast<uint8_t *>(left.data()),
+                        reinterpret_cast<uint8_t *>(right.data())};
+    return ring.read(data, nb_samples);
+  };
+  auto check_range = [&](int first, int nb_samples) {
+    for (int i = 0; i < nb_samples; ++i) {
+      CHECK(left[i] == static_cast<float>(first + i));
+      CHECK(right[i] == static_cast<float>(-(first + i)));
+    }
+  };
+  CHECK(ring.init(AV_SAMPLE_FMT_FLTP, 2, 4) == 0);
+
+  CHECK(write(0, 3) == 3);
+  CHECK(read(2) == 2);
+  check_range(0, 2);
+  /* Wrapped: samples 2..5 occupy positions 2, 3, 0, 1. */
+  CHECK(write(3, 3) == 3);
+  CHECK(ring.size() == 4);
+
+  CHECK(ring.reserve(16) == 0);
+  CHECK(ring.capacity() == 16);
+  CHECK(ring.size() == 4);
+  CHECK(write(6, 5) == 5);
+  CHECK(read(16) == 9);
+  check_range(2, 9);
+
+  ring.reset();
+  CHECK(ring.size() == 0);
+  CHECK(ring.space() == 16);
+}
+
+static void test_reorder_out_of_order() {
+  ReorderBuffer<int> buffer(4);
+  int item = -1;
+
+  CHECK(buffer.push(2, 20));
+  CHECK(buffer.push(0, 0));
+  CHECK(buffer.push(3, 30));
+  CHECK(buffer.push(1, 10));
+  for (int i = 0; i < 4; ++i) {
+    CHECK(buffer.pop(item));
+    CHECK(item == i * 10);
+  }
+
+  /* After close only the items in order come out. */
+  CHECK(buffer.push(6, 60));
+  CHECK(buffer.push(4, 40));
+  buffer.close();
+  CHECK(buffer.pop(item));
+  CHECK(item == 40);
+  CHECK(!buffer.pop(item));
+  CHECK(!buffer.push(5, 50));
+}
+
+static void test_reorder_capacity_blocks() {
+  ReorderBuffer<int> buffer(2);
+  std::atomic<bool> pushed{false};
+  int item = -1;
+
+  CHECK(buffer.push(1, 1));
+  std::thread producer([&] {
+    buffer.push(2, 2);
+    pushed = true;
+  });
+  /* Index 2 is capacity ahead of index 0, which has not been popped. */
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  CHECK(!pushed);
+  CHECK(buffer.push(0, 0));
+  CHECK(buffer.pop(item) && item == 0);
+  producer.join();
+  CHECK(pushed);
+  CHECK(buffer.pop(item) && item == 1);
+  CHECK(buffer.pop(item) && item == 2);
+}
+
+/// Workers finish in any order, the consumer must still see every index once
+/// and in order.
+static void test_reorder_concurrent() {
+  constexpr int kNbItems = 1000;
+  constexpr int kNbProducers = 4;
+  ReorderBuffer<int> buffer(3);
+  std::vector<std::thread> producers;
+
+  for (int k = 0; k < kNbProducers; ++k) {
+    producers.emplace_back([&buffer, k] {
+      for (int i = k; i < kNbItems; i += kNbProducers) {
+        if ((i * 7) % 5 == 0) {
+          std::this_thread::yield();
+        }
+        buffer.push(i, i);
+      }
+    });
+  }
+
+  int item = -1;
+  int nb_popped = 0;
+  while (nb_popped < kNbItems && buffer.pop(item)) {
+    CHECK(item == nb_popped);
+    ++nb_popped;
+  }
+  CHECK(nb_popped == kNbItems);
+  buffer.close();
+  for (auto &producer : producers) {
+    producer.join();
+  }
+}
+
+/// Counts the blocks handed out, to see which buffers were reallocated.
+class CountingResource : public std::pmr::memory_resource {
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+    ++nb_allocations;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void *p, std::size_t bytes,
+                     std::size_t alignment) override {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+
+  bool do_is_equal(
+      const std::pmr::memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+
+public:
+  std::size_t nb_allocations{0};
+};
+
+static Waveform stereo_waveform(std::size_t nb_frames) {
+  Waveform waveform{.nb_frames = nb_frames, .nb_channels = 2};
+  const std::vector<float> samples =
+      stereo_frames(0, static_cast<int>(nb_frames));
+  waveform.data.assign(samples.begin(), samples.end());
+  return waveform;
+}
+
+static bool same_samples(const WaveformView &a, const WaveformView &b) {
+  if (a.nb_frames != b.nb_frames || a.nb_channels != b.nb_channels) {
+    return false;
+  }
+  for (std::size_t i = 0; i < a.nb_frames; ++i) {
+    for (std::int32_t c = 0; c < a.nb_channels; ++c) {
+      if (a.frame(i)[c] != b.frame(i)[c]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/// Feeds nb_frames frames to a SegmentStream, piece frames at a time through
+/// append, or as much as nb_missing asks for through input when piece is 0,
+/// and compares the windows with those of segment_audio.
+static void check_segment_stream(std::size_t nb_frames, std::size_t segment,
+                                 std::size_t boundary, std::size_t piece) {
+  const Waveform input = stereo_waveform(nb_frames);
+  std::queue<Waveform> expected = segment_audio(input, segment, boundary);
+  CountingResource memory;
+  SegmentStream stream(segment, boundary, 2, &memory);
+  std::vector<SegmentWindow> windows;
+  std::size_t position = 0;
+
+  while (1) {
+    std::size_t n = piece ? piece : stream.nb_missing();
+    n = std::min(n, nb_frames - position);
+    if (piece) {
+      stream.append(input.sub_frames(position, position + n));
+    } else {
+      /* The way AudioDecoder::DecodeAppend fills it. */
+      Waveform &buffer = stream.input();
+      const WaveformView frames = input.view().sub_frames(position,
+                                                          position + n);
+      buffer.data.insert(buffer.data.end(), frames.data,
+                         frames.data + n * 2);
+      buffer.nb_frames += n;
+    }
+    position += n;
+    if (position == nb_frames) {
+      stream.finish();
+    }
+    while (auto window = stream.next()) {
+      CHECK(window->waveform.data.get_allocator().resource() == &memory);
+      windows.push_back(std::move(*window));
+    }
+    if (position == nb_frames) {
+      break;
+    }
+  }
+
+  CHECK(windows.size() == expected.size());
+  Waveform restored{.nb_frames = 0, .nb_channels = 2};
+  for (std::size_t i = 0; i < windows.size() && !expected.empty(); ++i) {
+    const SegmentWindow &window = windows[i];
+    CHECK(same_samples(window.waveform, expected.front()));
+    CHECK(window.head == (i != 0));
+    CHECK(window.tail == (i + 1 != windows.size()));
+    expected.pop();
+
+    const WaveformView part = restore_segment_audio(
+        window.waveform, boundary, window.head, window.tail);
+    restored.data.insert(restored.data.end(), part.data,
+                         part.data + part.nb_frames * 2);
+    restored.nb_frames += part.nb_frames;
+  }
+  CHECK(same_samples(restored, input));
+
+  /* Filled no further than it asks, every window is one allocation and only
+   * the overlap is copied into the next. */
+  if (!piece) {
+    CHECK(memory.nb_allocations == windows.size());
+  }
+}
+
+static void test_segment_stream() {
+  const std::size_t lengths[] = {0,  1,  9,  10, 11,  12,  13, 14,
+                                 15, 23, 24, 25, 100, 101, 257};
+  const std::size_t pieces[] = {0, 1, 3, 7, 10, 64};
+  for (std::size_t nb_frames : lengths) {
+    for (std::size_t piece : pieces) {
+      check_segment_stream(nb_frames, 10, 2, piece);
+      check_segment_stream(nb_frames, 10, 0, piece);
+      check_segment_stream(nb_frames, 5, 4, piece);
+    }
+  }
+}
+
+/// Rope over frames [0, 13) of stereo_waveform, in chunks of 3, 1, 4 and 5
+/// frames; the first chunk is prepended.
+static WaveformRope stereo_rope(const Waveform &reference) {
+  WaveformRope rope(2);
+  rope.append(reference.sub_frames(3, 4));
+  rope.append(reference.sub_frames(4, 8));
+  rope.append(reference.sub_frames(8, 13));
+  rope.prepend(reference.sub_frames(0, 3));
+  return rope;
+}
+
+static void test_rope_sub_frames() {
+  const Waveform reference = stereo_waveform(13);
+  const WaveformRope rope = stereo_rope(reference);
+  CHECK(rope.nb_frames() == 13 && rope.nb_chunks() == 4);
+  CHECK(same_samples(rope.to_waveform().view(), reference.view()));
+
+  int nb_mismatches = 0;
+  for (std::size_t start = 0; start <= 13; ++start) {
+    for (std::size_t end = start; end <= 13; ++end) {
+      const WaveformRope slice = rope.sub_frames(start, end);
+      const Waveform expected = reference.sub_frames(start, end);
+      nb_mismatches += slice.nb_frames() != end - start;
+      nb_mismatches +=
+          !same_samples(slice.to_waveform().view(), expected.view());
+      /* Only the chunks overlapping the slice are kept, none empty. */
+      for (std::size_t i = 0; i < slice.nb_chunks(); ++i) {
+        nb_mismatches += slice.chunk(i).nb_frames == 0;
+      }
+      nb_mismatches += start == end && slice.nb_chunks() != 0;
+    }
+  }
+  CHECK(nb_mismatches == 0);
+
+  /* Slices share the chunks and outlive the rope. */
+  WaveformRope slice(2);
+  {
+    const WaveformRope local = stereo_rope(reference);
+    slice = local.sub_frames(2, 9);
+    CHECK(slice.nb_chunks() == 4);
+    CHECK(slice.chunk(0).data == local.chunk(0).data + 2 * 2);
+    CHECK(slice.chunk(3).data == local.chunk(3).data);
+  }
+  CHECK(same_samples(slice.to_waveform().view(),
+                     reference.sub_frames(2, 9).view()));
+}
+
+static void test_rope_pop_front_frames() {
+  const Waveform reference = stereo_waveform(13);
+  int nb_mismatches = 0;
+  for (std::size_t first = 0; first <= 13; ++first) {
+    for (std::size_t second = 0; first + second <= 13; ++second) {
+      WaveformRope rope = stereo_rope(reference);
+      rope.pop_front_frames(first);
+      rope.pop_front_frames(second);
+      const std::size_t start = first + second;
+      nb_mismatches += rope.nb_frames() != 13 - start;
+      nb_mismatches += !same_samples(rope.to_waveform().view(),
+                                     reference.sub_frames(start, 13).view());
+      nb_mismatches += rope.nb_chunks() && rope.chunk(0).nb_frames == 0;
+    }
+  }
+  CHECK(nb_mismatches == 0);
+
+  WaveformRope rope = stereo_rope(reference);
+  rope.pop_front_frames(4);
+  CHECK(rope.nb_chunks() == 2);
+  rope.pop_front_frames(9);
+  CHECK(rope.empty() && rope.nb_chunks() == 0);
+}
+
+static void test_rope_chunks() {
+  const Waveform reference = stereo_waveform(13);
+  WaveformRope rope = stereo_rope(reference);
+
+  std::vector<std::size_t> sizes;
+  std::vector<float> samples;
+  CHECK(rope.for_each_chunk([&](const WaveformView &view) {
+    sizes.push_back(view.nb_frames);
+    samples.insert(samples.end(), view.data, view.data + view.nb_frames * 2);
+    return 1;
+  }) == 1);
+  CHECK((sizes == std::vector<std::size_t>{3, 1, 4, 5}));
+  CHECK((samples == std::vector<float>(reference.data.begin(),
+                                       reference.data.end())));
+
+  /* Stops at the first chunk refused and returns its result. */
+  int nb_calls = 0;
+  CHECK(rope.for_each_chunk([&](const WaveformView &) {
+    return ++nb_calls == 2 ? -5 : 1;
+  }) == -5);
+  CHECK(nb_calls == 2);
+
+  /* Joining ropes, also with itself, shares the chunks. */
+  WaveformRope joined = rope.sub_frames(8, 13);
+  joined.prepend(rope.sub_frames(0, 4));
+  CHECK(joined.nb_frames() == 9 && joined.nb_chunks() == 3);
+  joined += joined;
+  CHECK(joined.nb_frames() == 18 && joined.nb_chunks() == 6);
+  const Waveform head = reference.sub_frames(0, 4);
+  const Waveform tail = reference.sub_frames(8, 13);
+  for (std::size_t offset : {std::size_t{0}, std::size_t{9}}) {
+    const Waveform part = joined.sub_frames(offset, offset + 9).to_waveform();
+    CHECK(same_samples(part.view().sub_frames(0, 4), head.view()));
+    CHECK(same_samples(part.view().sub_frames(4, 9), tail.view()));
+  }
+
+  /* contiguous merges the chunks once, then hands out the same view. */
+  CountingResource memory;
+  const WaveformView view = rope.contiguous(&memory);
+  CHECK(memory.nb_allocations == 1 && rope.nb_chunks() == 1);
+  CHECK(same_samples(view, reference.view()));
+  CHECK(rope.contiguous(&memory).data == view.data);
+  CHECK(memory.nb_allocations == 1);
+  CHECK(WaveformRope(2).contiguous().nb_frames == 0);
+}
+
+static std::uint16_t half_bits(float value) {
+  return Half::from_float(value).bits;
+}
+
+/// Every binary16 value survives the trip through float unchanged.
+static void test_half_round_trip() {
+  int nb_mismatches = 0;
+  for (std::uint32_t bits = 0; bits <= 0xffff; ++bits) {
+    const Half half{static_cast<std::uint16_t>(bits)};
+    const float value = half.to_float();
+    const bool is_nan = (bits & 0x7c00) == 0x7c00 && (bits & 0x3ff);
+    if (is_nan) {
+      const Half back = Half::from_float(value);
+      nb_mismatches += !std::isnan(value) || !std::isnan(back.to_float());
+    } else {
+      nb_mismatches += half_bits(value) != bits;
+    }
+  }
+  CHECK(nb_mismatches == 0);
+}
+
+static void test_half_rounding() {
+  /* Exact values. */
+  CHECK(half_bits(0.0f) == 0x0000);
+  CHECK(half_bits(-0.0f) == 0x8000);
+  CHECK(half_bits(1.0f) == 0x3c00);
+  CHECK(half_bits(-2.0f) == 0xc000);
+  CHECK(half_bits(65504.0f) == 0x7bff);
+  CHECK(half_bits(0x1p-14f) == 0x0400);
+  CHECK(half_bits(0x1p-24f) == 0x0001);
+  CHECK(half_bits(0x3ffp-24f) == 0x03ff);
+
+  /* Halfway cases round to the even neighbour, others to the nearest. */
+  CHECK(half_bits(1.0f + 0x1p-11f) == 0x3c00);
+  CHECK(half_bits(1.0f + 0x3p-11f) == 0x3c02);
+  CHECK(half_bits(1.0f + 0x1p-11f + 0x1p-20f) == 0x3c01);
+  CHECK(half_bits(0x1p-25f) == 0x0000);
+  CHECK(half_bits(0x3p-25f) == 0x0002);
+  CHECK(half_bits(0x1p-25f + 0x1p-35f) == 0x0001);
+  CHECK(half_bits(0x1p-26f) == 0x0000);
+  /* A carry out of the mantissa moves up to the next binade. */
+  CHECK(half_bits(0x7ffp-25f) == 0x0400);
+  CHECK(half_bits(2.0f - 0x1p-12f) == 0x4000);
+
+  /* Out of range and special values. */
+  CHECK(half_bits(65519.0f) == 0x7bff);
+  CHECK(half_bits(65520.0f) == 0x7c00);
+  CHECK(half_bits(1e10f) == 0x7c00);
+  CHECK(half_bits(-1e10f) == 0xfc00);
+  CHECK(half_bits(INFINITY) == 0x7c00);
+  CHECK(std::isnan(Half::from_float(NAN).to_float()));
+
+  /* Sample conversions through Half. */
+  CHECK(sample_cast<float>(sample_cast<Half>(0.5f)) == 0.5f);
+  CHECK(sample_cast<std::int16_t>(sample_cast<Half>(-1.0f)) == -32768);
+  CHECK(sample_cast<std::int16_t>(sample_cast<Half>(1.0f)) == 32767);
+}
+
+/// MP4 into a sink that cannot seek is fragmented, and the fragments reach
+/// the sink while encoding goes on rather than all at the trailer.
+static void test_unseekable_sink_streams() {
+  auto bytes = std::make_shared<std::vector<uint8_t>>();
+  avpro::OutputSink sink;
+  sink.write = [bytes](const uint8_t *data, int size) {
+    bytes->insert(bytes->end(), data, data + size);
+    return size;
+  };
+  sink.format = "mp4";
+  sink.buffer_size = 4096;
+
+  AVChannelLayout layout;
+  av_channel_layout_default(&layout, 2);
+  CancelToken cancel_token;
+  auto encoder = codec::FFmpegAudioEncoder::create(
+      "", 44100, AV_SAMPLE_FMT_FLT, layout, 128000, &cancel_token, nullptr,
+      &sink);
+  av_channel_layout_uninit(&layout);
+  CHECK(encoder);
+  if (!encoder) {
+    return;
+  }
+
+  /* 5 s of a 440 Hz tone. */
+  std::vector<float> samples(2 * 1024);
+  std::size_t frame = 0;
+  for (int i = 0; i < 5 * 44100 / 1024; ++i) {
+    for (std::size_t j = 0; j < 1024; ++j, ++frame) {
+      const float x = 0.5f * std::sin(2 * 3.14159265f * 440 * frame / 44100);
+      samples[2 * j] = samples[2 * j + 1] = x;
+    }
+    CHECK(encoder->encode(reinterpret_cast<const uint8_t *>(samples.data()),
+                          1024) >= 0);
+  }
+  const std::size_t nb_streamed = bytes->size();
+  CHECK(encoder->finish() >= 0);
+  encoder.reset();
+  /* Several fragments out before the trailer, only the last one after. */
+  CHECK(nb_streamed > bytes->size() / 2);
+}
+
+int main() {
+  test_ring_wrap_around();
+  test_ring_partial_write();
+  test_ring_carry_over_planar();
+  test_reorder_out_of_order();
+  test_reorder_capacity_blocks();
+  test_reorder_concurrent();
+  test_segment_stream();
+  test_rope_sub_frames();
+  test_rope_pop_front_frames();
+  test_rope_chunks();
+  test_half_round_trip();
+  test_half_rounding();
+  test_unseekable_sink_streams();
+
+  if (nb_failures) {
+    fprintf(stderr, "%d check(s) failed\n", nb_failures);
+  }
+  return nb_failures;
+}
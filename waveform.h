@@ -6,58 +6,290 @@
 #ifndef SPLEETER_DATATYPES_WAVEFORM_H
 #define SPLEETER_DATATYPES_WAVEFORM_H
 
+#include "aligned_resource.h"
+#include "sample_types.h"
 #include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <memory_resource>
 #include <ostream>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace spleeter {
-struct Waveform {
+template <typename Sample, typename Layout> struct BasicWaveform;
+
+/// Non-owning view of interleaved samples. Frame i starts at
+/// data + i * stride, so a view can also select channels out of a wider
+/// frame. Slicing is O(1), the viewed storage must outlive the view.
+template <typename Sample> struct BasicWaveformView {
+  const Sample *data;
+  std::size_t nb_frames;
+  std::int32_t nb_channels;
+  /// samples from one frame to the next, nb_channels when packed
+  std::size_t stride;
+
+  /// Frames are adjacent, data can be used as one interleaved block.
+  bool contiguous() const {
+    return stride == static_cast<std::size_t>(nb_channels);
+  }
+
+  const Sample *frame(std::size_t index) const {
+    return data + index * stride;
+  }
+
+  BasicWaveformView sub_end_frames(std::size_t start) const {
+    return sub_frames(start, this->nb_frames);
+  }
+
+  BasicWaveformView sub_frames(std::size_t start, std::size_t end) const {
+    assert(start <= end && end <= nb_frames);
+    return BasicWaveformView{.data = frame(start),
+                             .nb_frames = end - start,
+                             .nb_channels = nb_channels,
+                             .stride = stride};
+  }
+
+  /// Owning copy of the viewed samples, allocated from memory.
+  inline BasicWaveform<Sample, Interleaved>
+  to_waveform(std::pmr::memory_resource *memory = sample_memory()) const;
+};
+
+/// polymorphic_allocator that default-initialises: resize(n) leaves the new
+/// samples unset instead of zeroing them, so a decoder can size a buffer and
+/// then write it without a memset first. resize(n, Sample{}) for silence.
+template <typename T>
+class SampleAllocator : public std::pmr::polymorphic_allocator<T> {
+  using Base = std::pmr::polymorphic_allocator<T>;
+
+public:
+  SampleAllocator() noexcept = default;
+
+  SampleAllocator(std::pmr::memory_resource *memory) noexcept
+      : Base(memory) {}
+
+  template <typename U>
+  SampleAllocator(const SampleAllocator<U> &other) noexcept
+      : Base(other.resource()) {}
+
+  template <typename U> void construct(U *p) {
+    ::new (static_cast<void *>(p)) U;
+  }
+
+  template <typename U, typename... Args>
+  void construct(U *p, Args &&...args) {
+    Base::construct(p, std::forward<Args>(args)...);
+  }
+
+  /// Copies use the default resource, like std::pmr containers.
+  SampleAllocator select_on_container_copy_construction() const {
+    return SampleAllocator();
+  }
+};
+
+template <typename Sample>
+using SampleVector = std::vector<Sample, SampleAllocator<Sample>>;
+
+/// Audio samples of type Sample (float, std::int16_t or Half) in Layout
+/// (Interleaved or Planar). The storage comes from a memory_resource so a
+/// pipeline can recycle it, sample_memory() if none is given, which keeps it
+/// 64-byte aligned and padded. Slices and sums allocate from the resource of
+/// their source; plain copies follow the pmr rules and use the default
+/// resource.
+template <typename Sample, typename Layout = Interleaved>
+struct BasicWaveform {
+  using sample_type = Sample;
+  using layout_type = Layout;
+  static constexpr bool kPlanar = std::is_same_v<Layout, Planar>;
+  static_assert(kPlanar || std::is_same_v<Layout, Interleaved>,
+                "Layout is Interleaved or Planar");
+
   std::size_t nb_frames;
   std::int32_t nb_channels;
-  std::vector<float> data;
+  SampleVector<Sample> data{sample_memory()};
+
+  /// Empty waveform whose storage will come from memory.
+  static BasicWaveform with_resource(std::int32_t nb_channels,
+                                     std::pmr::memory_resource *memory) {
+    return BasicWaveform{.nb_frames = 0,
+                         .nb_channels = nb_channels,
+                         .data = SampleVector<Sample>(memory)};
+  }
+
+  /// Position of a sample in data.
+  std::size_t index(std::size_t frame, std::int32_t channel) const {
+    if constexpr (kPlanar) {
+      return channel * nb_frames + frame;
+    } else {
+      return frame * nb_channels + channel;
+    }
+  }
+
+  Sample &at(std::size_t frame, std::int32_t channel) {
+    return data[index(frame, channel)];
+  }
 
-  Waveform sub_end_frames(std::size_t start) const {
+  const Sample &at(std::size_t frame, std::int32_t channel) const {
+    return data[index(frame, channel)];
+  }
+
+  /// Samples of one channel, planar layout only.
+  Sample *plane(std::int32_t channel) {
+    static_assert(kPlanar, "plane() needs the planar layout");
+    return data.data() + channel * nb_frames;
+  }
+
+  const Sample *plane(std::int32_t channel) const {
+    static_assert(kPlanar, "plane() needs the planar layout");
+    return data.data() + channel * nb_frames;
+  }
+
+  BasicWaveformView<Sample> view() const {
+    static_assert(!kPlanar, "views need the interleaved layout");
+    return BasicWaveformView<Sample>{
+        .data = data.data(),
+        .nb_frames = nb_frames,
+        .nb_channels = nb_channels,
+        .stride = static_cast<std::size_t>(nb_channels)};
+  }
+
+  operator BasicWaveformView<Sample>() const { return view(); }
+
+  BasicWaveform sub_end_frames(std::size_t start) const {
     return sub_frames(start, this->nb_frames);
   }
 
-  Waveform sub_frames(std::size_t start, std::size_t end) const {
+  BasicWaveform sub_frames(std::size_t start, std::size_t end) const {
     std::size_t count = end - start;
-    return Waveform{.nb_frames = count,
-                    .nb_channels = nb_channels,
-                    .data =
-                        std::vector<float>(data.cbegin() + start * nb_channels,
-                                           data.cbegin() + end * nb_channels)};
+    BasicWaveform ret{.nb_frames = count,
+                      .nb_channels = nb_channels,
+                      .data = SampleVector<Sample>(data.get_allocator())};
+    if constexpr (kPlanar) {
+      ret.data.resize(count * nb_channels);
+      for (std::int32_t c = 0; c < nb_channels; ++c) {
+        std::copy(plane(c) + start, plane(c) + end, ret.plane(c));
+      }
+    } else {
+      ret.data.assign(data.cbegin() + start * nb_channels,
+                      data.cbegin() + end * nb_channels);
+    }
+    return ret;
   }
 
-  Waveform &operator+=(const Waveform &other) {
+  /// Copies the samples of both sides; WaveformRope joins without copying.
+  BasicWaveform &operator+=(const BasicWaveform &other) {
     assert(nb_channels == other.nb_channels);
-    this->nb_frames += other.nb_frames;
-    this->data.insert(this->data.end(), other.data.cbegin(), other.data.cend());
+    if constexpr (kPlanar) {
+      *this = *this + other;
+    } else {
+      this->nb_frames += other.nb_frames;
+      this->data.insert(this->data.end(), other.data.cbegin(),
+                        other.data.cend());
+    }
     return *this;
   }
 
-  Waveform operator+(const Waveform &other) const {
+  BasicWaveform operator+(const BasicWaveform &other) const {
     assert(nb_channels == other.nb_channels);
-    std::vector<float> d = this->data;
-    d.insert(d.end(), other.data.cbegin(), other.data.cend());
-    Waveform ret{
+    BasicWaveform ret{
         .nb_frames = this->nb_frames + other.nb_frames,
         .nb_channels = other.nb_channels,
-        .data = std::move(d),
+        .data = SampleVector<Sample>(this->data.get_allocator()),
     };
+    if constexpr (kPlanar) {
+      /* Every plane grows, so all of them move. */
+      ret.data.resize(ret.nb_frames * ret.nb_channels);
+      for (std::int32_t c = 0; c < nb_channels; ++c) {
+        std::copy(plane(c), plane(c) + nb_frames, ret.plane(c));
+        std::copy(other.plane(c), other.plane(c) + other.nb_frames,
+                  ret.plane(c) + nb_frames);
+      }
+    } else {
+      ret.data.reserve(this->data.size() + other.data.size());
+      ret.data.assign(this->data.cbegin(), this->data.cend());
+      ret.data.insert(ret.data.end(), other.data.cbegin(), other.data.cend());
+    }
     return ret;
   }
 };
 
+/// Interleaved float samples, the format the codecs and the separation
+/// model exchange.
+using Waveform = BasicWaveform<float, Interleaved>;
+using WaveformView = BasicWaveformView<float>;
+
+template <typename Sample>
+inline BasicWaveform<Sample, Interleaved>
+BasicWaveformView<Sample>::to_waveform(
+    std::pmr::memory_resource *memory) const {
+  BasicWaveform<Sample, Interleaved> ret{
+      .nb_frames = nb_frames,
+      .nb_channels = nb_channels,
+      .data = SampleVector<Sample>(memory)};
+  if (contiguous()) {
+    ret.data.assign(data, data + nb_frames * nb_channels);
+    return ret;
+  }
+  ret.data.resize(nb_frames * nb_channels);
+  for (std::size_t i = 0; i < nb_frames; ++i) {
+    std::copy(frame(i), frame(i) + nb_channels,
+              ret.data.begin() + i * nb_channels);
+  }
+  return ret;
+}
+
+/// Copy of src with the sample type and layout of To, e.g.
+/// waveform_cast<BasicWaveform<Half, Planar>>(waveform) to keep a stem in
+/// half the memory. Sample conversion is chosen at compile time, layout
+/// changes of float samples use the interleave kernels.
+template <typename To, typename Sample, typename Layout>
+To waveform_cast(const BasicWaveform<Sample, Layout> &src,
+                 std::pmr::memory_resource *memory = sample_memory()) {
+  using ToSample = typename To::sample_type;
+  const std::size_t n = src.nb_frames * src.nb_channels;
+  To dst = To::with_resource(src.nb_channels, memory);
+  dst.nb_frames = src.nb_frames;
+  dst.data.resize(n);
+
+  if constexpr (std::is_same_v<Layout, typename To::layout_type>) {
+    convert_samples(dst.data.data(), src.data.data(), n);
+  } else if constexpr (std::is_same_v<Sample, float> &&
+                       std::is_same_v<ToSample, float>) {
+    if constexpr (To::kPlanar) {
+      std::vector<float *> planes(src.nb_channels);
+      for (std::int32_t c = 0; c < src.nb_channels; ++c) {
+        planes[c] = dst.plane(c);
+      }
+      avpro::kernels::deinterleave(planes.data(), src.data.data(),
+                                   src.nb_channels, src.nb_frames);
+    } else {
+      std::vector<const float *> planes(src.nb_channels);
+      for (std::int32_t c = 0; c < src.nb_channels; ++c) {
+        planes[c] = src.plane(c);
+      }
+      avpro::kernels::interleave(dst.data.data(), planes.data(),
+                                 src.nb_channels, src.nb_frames);
+    }
+  } else {
+    for (std::size_t i = 0; i < src.nb_frames; ++i) {
+      for (std::int32_t c = 0; c < src.nb_channels; ++c) {
+        dst.at(i, c) = sample_cast<ToSample>(src.at(i, c));
+      }
+    }
+  }
+  return dst;
+}
+
 /// @brief List of waveforms
 using Waveforms = std::vector<Waveform>;
 
 /// @brief Provide output stream for waveform (list of samples), prints number
 /// of samples it holds.
-inline std::ostream &operator<<(std::ostream &out, const Waveform &waveform) {
+template <typename Sample, typename Layout>
+inline std::ostream &operator<<(std::ostream &out,
+                                const BasicWaveform<Sample, Layout> &waveform) {
   out << "Waveform{nb_frames: " << waveform.nb_frames
       << ", nb_channels: " << waveform.nb_channels
       << ", nb_size: " << waveform.data.size() << "}";
@@ -0,0 +1,125 @@
+#include "waveform_rope.h"
+#include <algorithm>
+#include <cassert>
+
+namespace spleeter {
+
+WaveformRope::Chunk
+WaveformRope::make_chunk(std::shared_ptr<const Waveform> waveform) {
+  const std::size_t nb_frames = waveform->nb_frames;
+  return Chunk{.waveform = std::move(waveform),
+               .start = 0,
+               .nb_frames = nb_frames};
+}
+
+void WaveformRope::append(Waveform &&waveform) {
+  append(std::make_shared<const Waveform>(std::move(waveform)));
+}
+
+void WaveformRope::append(std::shared_ptr<const Waveform> waveform) {
+  assert(waveform->nb_channels == nb_channels_ || !waveform->nb_frames);
+  if (!waveform->nb_frames) {
+    return;
+  }
+  nb_frames_ += waveform->nb_frames;
+  chunks_.push_back(make_chunk(std::move(waveform)));
+}
+
+void WaveformRope::append(const WaveformRope &other) {
+  assert(other.nb_channels_ == nb_channels_ || other.empty());
+  /* Copy first, other may be this rope. */
+  const std::deque<Chunk> chunks = other.chunks_;
+  chunks_.insert(chunks_.end(), chunks.begin(), chunks.end());
+  nb_frames_ += other.nb_frames_;
+}
+
+void WaveformRope::prepend(Waveform &&waveform) {
+  prepend(std::make_shared<const Waveform>(std::move(waveform)));
+}
+
+void WaveformRope::prepend(std::shared_ptr<const Waveform> waveform) {
+  assert(waveform->nb_channels == nb_channels_ || !waveform->nb_frames);
+  if (!waveform->nb_frames) {
+    return;
+  }
+  nb_frames_ += waveform->nb_frames;
+  chunks_.push_front(make_chunk(std::move(waveform)));
+}
+
+void WaveformRope::prepend(const WaveformRope &other) {
+  assert(other.nb_channels_ == nb_channels_ || other.empty());
+  const std::deque<Chunk> chunks = other.chunks_;
+  chunks_.insert(chunks_.begin(), chunks.begin(), chunks.end());
+  nb_frames_ += other.nb_frames_;
+}
+
+WaveformRope WaveformRope::sub_frames(std::size_t start,
+                                      std::size_t end) const {
+  assert(start <= end && end <= nb_frames_);
+  WaveformRope ret(nb_channels_);
+  std::size_t position = 0;
+
+  for (const Chunk &chunk : chunks_) {
+    const std::size_t chunk_end = position + chunk.nb_frames;
+    /* Overlap of [start, end) with the chunk, relative to the chunk. */
+    const std::size_t first = std::max(start, position) - position;
+    const std::size_t last = std::min(end, chunk_end) - position;
+    if (start < chunk_end && first < last) {
+      ret.chunks_.push_back(Chunk{.waveform = chunk.waveform,
+                                  .start = chunk.start + first,
+                                  .nb_frames = last - first});
+      ret.nb_frames_ += last - first;
+    }
+    if (chunk_end >= end) {
+      break;
+    }
+    position = chunk_end;
+  }
+  return ret;
+}
+
+void WaveformRope::pop_front_frames(std::size_t nb_frames) {
+  assert(nb_frames <= nb_frames_);
+  nb_frames_ -= nb_frames;
+  while (nb_frames) {
+    Chunk &front = chunks_.front();
+    if (front.nb_frames > nb_frames) {
+      front.start += nb_frames;
+      front.nb_frames -= nb_frames;
+      break;
+    }
+    nb_frames -= front.nb_frames;
+    chunks_.pop_front();
+  }
+}
+
+WaveformView WaveformRope::contiguous(std::pmr::memory_resource *memory) {
+  if (chunks_.empty()) {
+    return WaveformView{.data = nullptr,
+                        .nb_frames = 0,
+                        .nb_channels = nb_channels_,
+                        .stride = static_cast<std::size_t>(nb_channels_)};
+  }
+  if (chunks_.size() > 1) {
+    Chunk merged = make_chunk(std::make_shared<const Waveform>(
+        to_waveform(memory)));
+    chunks_.clear();
+    chunks_.push_back(std::move(merged));
+  }
+  return chunks_.front().view();
+}
+
+Waveform WaveformRope::to_waveform(std::pmr::memory_resource *memory) const {
+  Waveform ret = Waveform::with_resource(nb_channels_, memory);
+  ret.nb_frames = nb_frames_;
+  ret.data.resize(nb_frames_ * nb_channels_);
+  float *p = ret.data.data();
+
+  for (const Chunk &chunk : chunks_) {
+    const WaveformView view = chunk.view();
+    p = std::copy(view.data, view.data + view.nb_frames * nb_channels_, p);
+  }
+  return ret;
+}
+
+} // namespace spleeter
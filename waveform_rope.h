@@ -0,0 +1,99 @@
+#ifndef SPLEETER_WAVEFORM_ROPE_H
+#define SPLEETER_WAVEFORM_ROPE_H
+
+#include "waveform.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+namespace spleeter {
+
+/// Waveform kept as a sequence of chunks. Appending or prepending a chunk is
+/// O(1) and joining, slicing or trimming ropes costs O(chunks), never a
+/// sample copy. Chunks are shared and immutable, so a slice may outlive the
+/// rope it was taken from. A contiguous view is only built when asked for.
+class WaveformRope {
+  struct Chunk {
+    std::shared_ptr<const Waveform> waveform;
+    std::size_t start;
+    std::size_t nb_frames;
+
+    WaveformView view() const {
+      return waveform->view().sub_frames(start, start + nb_frames);
+    }
+  };
+
+  std::int32_t nb_channels_;
+  std::size_t nb_frames_{0};
+  std::deque<Chunk> chunks_;
+
+  static Chunk make_chunk(std::shared_ptr<const Waveform> waveform);
+
+public:
+  explicit WaveformRope(std::int32_t nb_channels) : nb_channels_(nb_channels) {}
+
+  std::size_t nb_frames() const { return nb_frames_; }
+
+  std::int32_t nb_channels() const { return nb_channels_; }
+
+  bool empty() const { return nb_frames_ == 0; }
+
+  std::size_t nb_chunks() const { return chunks_.size(); }
+
+  /// Frames of chunk index, in order.
+  WaveformView chunk(std::size_t index) const {
+    return chunks_[index].view();
+  }
+
+  void append(Waveform &&waveform);
+
+  void append(std::shared_ptr<const Waveform> waveform);
+
+  void append(const WaveformRope &other);
+
+  void prepend(Waveform &&waveform);
+
+  void prepend(std::shared_ptr<const Waveform> waveform);
+
+  void prepend(const WaveformRope &other);
+
+  WaveformRope &operator+=(const WaveformRope &other) {
+    append(other);
+    return *this;
+  }
+
+  /// Frames [start, end) sharing the chunks of this rope.
+  WaveformRope sub_frames(std::size_t start, std::size_t end) const;
+
+  /// Drop nb_frames frames from the front.
+  void pop_front_frames(std::size_t nb_frames);
+
+  /// Calls f with the view of every chunk in order and stops at the first
+  /// result <= 0, which is returned; 1 when every chunk was accepted. Fits
+  /// AudioEncoder::Encode.
+  template <typename F> int for_each_chunk(F &&f) const {
+    for (const Chunk &chunk : chunks_) {
+      if (!chunk.nb_frames) {
+        continue;
+      }
+      const int ret = f(chunk.view());
+      if (ret <= 0) {
+        return ret;
+      }
+    }
+    return 1;
+  }
+
+  /// The samples as one contiguous view. Free for zero or one chunk,
+  /// otherwise the chunks are merged into a single one from memory first.
+  WaveformView contiguous(std::pmr::memory_resource *memory = sample_memory());
+
+  /// Contiguous copy of the samples.
+  Waveform to_waveform(
+      std::pmr::memory_resource *memory = sample_memory()) const;
+};
+
+} // namespace spleeter
+
+#endif